@@ -0,0 +1,51 @@
+/*
+
+    Definition file for high-precision fixed-point numbers.
+
+*/
+
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+#include "stdint.h"
+
+/* Numbers are held in BIG_LIMBS 32-bit limbs, most significant first.
+   The first limb is the integer part in two's complement and the rest are
+   the fraction, so numbers from -2^31 to 2^31 are held to a resolution of
+   2^-(32 * (BIG_LIMBS - 1)), about 1e-298. */
+#define BIG_LIMBS 32
+
+typedef struct
+{
+    uint32_t limb[BIG_LIMBS];
+} BIG_Number;
+
+void BIG_Zero( BIG_Number* r );
+
+/* Converts from a double exactly, apart from bits below the resolution,
+   and back to the nearest double. */
+void BIG_FromDouble( BIG_Number* r, double d );
+double BIG_ToDouble( const BIG_Number* a );
+
+int BIG_IsZero( const BIG_Number* a );
+int BIG_Equal( const BIG_Number* a, const BIG_Number* b );
+
+/* r may be the same number as a or b. */
+void BIG_Add( BIG_Number* r, const BIG_Number* a, const BIG_Number* b );
+void BIG_Sub( BIG_Number* r, const BIG_Number* a, const BIG_Number* b );
+
+/* r = a * 2^exponent, rounding down. */
+void BIG_Ldexp( BIG_Number* r, const BIG_Number* a, int exponent );
+
+/* r = a * b to the first limbs limbs, the rest of r being cleared, so that
+   a calculation needing less precision than BIG_LIMBS can pay for only
+   what it needs. Limbs past limbs in a and b are ignored. */
+void BIG_Mul( BIG_Number* r, const BIG_Number* a, const BIG_Number* b, int limbs );
+
+/* r = a * n exactly, as long as the product is in range. */
+void BIG_MulInt( BIG_Number* r, const BIG_Number* a, int64_t n );
+
+/* The number of limbs that hold a number to within 2^-bits. */
+int BIG_LimbsFor( int bits );
+
+#endif
@@ -0,0 +1,38 @@
+/*
+
+    Definition file for double-double escape-time iteration.
+
+*/
+
+#ifndef DDOUBLE_H
+#define DDOUBLE_H
+
+#include "bignum.h"
+#include "simd.h"
+
+/* A number held as the unevaluated sum of two doubles, hi + lo, with lo
+   no bigger than half an ulp of hi, for about 106 bits of precision. */
+typedef struct
+{
+    double hi, lo;
+} DD_Number;
+
+/* The double-double nearest a. */
+void DD_FromBig( DD_Number* r, const BIG_Number* a );
+
+/* The point the pixels of a batch are offsets from. A pixel starts at
+   (zx, zy) plus the z it was queued with, and iterates with c at
+   (cx, cy) plus the c it was queued with. */
+typedef struct
+{
+    DD_Number zx, zy;
+    DD_Number cx, cy;
+} DD_Base;
+
+/* Iterates and empties the batch as SIMD_RunBatch does, but in
+   double-double arithmetic off base. The output holds the pixels' final z
+   rounded to doubles. */
+void DD_RunBatch( const DD_Base* base, SIMD_Batch* batch, uint16_t max, double tolerance,
+                  SIMD_BatchOutput* out, SIMD_BatchStats* stats );
+
+#endif
@@ -13,9 +13,235 @@
 #include "stdint.h"
 #include "math.h"
 #include "complex.h"
+#include "bignum.h"
 
 typedef void (*PlotFunction)(uint16_t iterations, void* copyloc );
 
+/* Colors count consecutive pixels of one row in a single call. iterations
+   holds their escape counts, and smooth their fractional escape counts if
+   the colorizer asked for them, NULL otherwise. The colors are written to
+   consecutive pixels starting at dst. */
+typedef void (*SpanFunction)( const uint16_t* iterations, const float* smooth, int count,
+                              void* dst, void* userdata );
+
+/* A span function along with the size in bytes of the pixels it writes,
+   whether it needs smooth escape counts, and the userdata passed to it. */
+typedef struct
+{
+    SpanFunction func;
+    size_t elsize;
+    int smooth;
+    void* userdata;
+} SpanColorizer;
+
+/* Render strategies for the F plotters. Brute force iterates every pixel.
+   Subdivision iterates rectangle borders, fills rectangles whose border
+   has a single count, and splits the rest. Boundary tracing iterates
+   along the edges between regions of equal count and fills the regions. */
+#define RENDER_BRUTEFORCE 0
+#define RENDER_SUBDIVIDE 1
+#define RENDER_BOUNDARY 2
+#define RENDER_STRATEGIES 3
+
+/* How perturbed plots skip iterations: series approximation fitted to the
+   whole view, or bilinear approximation for each pixel, with rebasing. */
+#define APPROX_SERIES 0
+#define APPROX_BLA 1
+#define APPROX_MODES 2
+
+/* A view whose pixels lie on a grid that halves at every zoom level.
+   Pixel (i, j) sits at re + (x + i) * dre * 2^-level on the real axis and
+   im + (y + j) * dim * 2^-level on the imaginary axis. A 2x zoom doubles
+   x and y, so every other pixel of the zoomed view lands exactly on a
+   pixel of the previous one, and its count can be carried over.
+   preview is set on views made by PreviewView.
+
+   Views with pixels smaller than DEEP_PIXELSIZE are past what doubles can
+   tell apart, and are plotted in double-double arithmetic instead, down
+   to PERTURB_PIXELSIZE, and by perturbation past that. Their origin is
+   re + offre and im + offim, held to high precision, and once x or y grow
+   too large for a double they are moved into the origin. Views can zoom
+   in until pixels are VIEW_MIN_PIXELSIZE across. */
+#define DEEP_PIXELSIZE 1e-13
+#define PERTURB_PIXELSIZE 1e-28
+#define VIEW_MIN_PIXELSIZE 1e-280
+
+typedef struct
+{
+    double re, im;
+    double dre, dim;
+    int level;
+    int64_t x, y;
+    int preview;
+    BIG_Number offre, offim;
+} FractalView;
+
+/* A point held to high precision, as re + offre and im + offim. */
+typedef struct
+{
+    double re, im;
+    BIG_Number offre, offim;
+} FractalPoint;
+
+/* Sets a level 0 view spanning upperleft to lowerright over w x h pixels. */
+void SetView( FractalView* view, complex double upperleft, complex double lowerright,
+              uint16_t w, uint16_t h );
+
+/* Zooms in 2x, keeping pixel (i, j) at the same point. Does nothing once
+   the pixels would be smaller than VIEW_MIN_PIXELSIZE. */
+void ZoomView( FractalView* view, int i, int j );
+
+/* Zooms in by any ratio, keeping pixel (i, j) at the same point. Only a
+   ratio of 2 stays on the grid, as ZoomView; any other starts a new level
+   0 grid, so the next plot has no earlier pixels or tiles to draw on.
+   Like ZoomView, stops zooming in at VIEW_MIN_PIXELSIZE. */
+void ScaleView( FractalView* view, double ratio, int i, int j );
+
+/* The point under pixel (i, j) of the view. */
+complex double ViewPoint( const FractalView* view, int i, int j );
+
+/* The same point, to the view's full precision. */
+void ViewPrecisePoint( const FractalView* view, int i, int j, FractalPoint* point );
+
+/* Sets point to c, and tells whether two points are the same. */
+void SetPoint( FractalPoint* point, complex double c );
+int SamePoint( const FractalPoint* a, const FractalPoint* b );
+
+/* How far pixel (0, 0) of view from lies from pixel (0, 0) of view to,
+   worked out in high precision so that it is right at any depth. */
+complex double ViewOffset( const FractalView* from, const FractalView* to );
+
+/* The size of the view's pixels, the smaller of their width and height. */
+double ViewPixelSize( const FractalView* view );
+
+/* A coarse pass of view for progressive rendering: the same grid shift
+   levels up, so that preview pixel (i, j) lies exactly on view pixel
+   (i * 2^shift - offx, j * 2^shift - offy). Its samples are cached and
+   reused by the finer passes, and a preview is never the frame the next
+   plot reuses pixels from, so the full plot still draws on the last one. */
+void PreviewView( FractalView* preview, const FractalView* view, int shift,
+                  int* offx, int* offy );
+
+/* Work counters for the most recent F, Spans or View plot. Iterated
+   pixels are those actually run through the kernel, and reused pixels
+   are carried over from the previous plot or a cached tile of the zoom
+   level above, which had a sample at exactly the same point. Resumed
+   pixels carried on from where the previous plot's lower maxiter stopped
+   them rather than starting over; those it found to be periodic are
+   reused with the new maxiter instead. Tiles counts the tiles rendered,
+   cached tiles those taken whole from the tile cache, and file tiles
+   those of them read back from the tile cache file. A lane step is one
+   SIMD lane for one iteration; an active step is one where that lane held
+   a pixel still being iterated. Cardioid skips are Mandelbrot pixels
+   given maxiter by MandelbrotInterior without iterating, and cycle skips
+   are pixels stopped early by the periodicity check. Cancelled tiles were
+   skipped after a CancelRender. Reference bits is the precision a
+   perturbed plot's reference orbit was computed to, 0 for other plots,
+   and reference length the number of iterations in it. References counts
+   the reference orbits a perturbed plot was rendered off, and reiterated
+   pixels those iterated again off a secondary reference after glitching.
+   Approximation is the APPROX_ method a perturbed plot used. Series skip
+   is the iterations series approximation let every pixel skip, skipped
+   steps the iterations the approximation skipped over all pixels, and
+   saved ms an estimate of the time that saved, at the rate the plot
+   iterated the rest. Rebases counts the times bilinear approximation
+   moved pixels back to the start of the reference orbit. Double-double is
+   set for a plot iterated in double-double arithmetic. */
+typedef struct
+{
+    uint64_t pixels;
+    uint64_t iterated;
+    uint64_t reused;
+    uint64_t resumed;
+    uint64_t tiles;
+    uint64_t cachedtiles;
+    uint64_t filetiles;
+    int threads;
+    int strategy;
+    uint64_t lanesteps;
+    uint64_t activesteps;
+    uint64_t cardioidskips;
+    uint64_t cycleskips;
+    uint64_t cancelledtiles;
+    int referencebits;
+    int referencelength;
+    int references;
+    uint64_t reiterated;
+    int approximation;
+    int seriesskip;
+    uint64_t skippedsteps;
+    double savedms;
+    uint64_t rebases;
+    int doubledouble;
+} RenderStats;
+
+void GetRenderStats( RenderStats* stats );
+
+/* Makes the plot running on another thread stop before its next tile,
+   leaving its output unfinished. The tiles it skips are not kept for
+   reuse by later plots. Plots started after the call are not affected.
+   Safe to call from any thread. */
+void CancelRender( void );
+
+/* The number of CancelRender calls so far. Safe to call from any thread. */
+int GetRenderGeneration( void );
+
+/* Makes subsequent plots belong to generation, as read by
+   GetRenderGeneration, so that any CancelRender since that read cancels
+   them, even one made before they start. -1, the default, makes each plot
+   belong to the generation it starts in. */
+void SetRenderGeneration( int generation );
+
+/* Sets the number of threads the F plotters render with. 0, the default,
+   uses one per CPU. */
+void SetRenderThreads( int threads );
+
+/* Turns periodicity checking on or off. When on, the default, orbits that
+   settle into a cycle are given maxiter without running to it. */
+void SetPeriodicityCheck( int enabled );
+int GetPeriodicityCheck( void );
+
+/* Turns reuse of the previous plot's counts on or off. When on, the
+   default, a plot of the same fractal with the same or a higher maxiter
+   copies the counts of pixels that sit exactly where a computed pixel of
+   the previous plot did. Pixels the previous plot stopped at its maxiter
+   are iterated on from where they stopped, so raising maxiter only costs
+   the pixels that had not escaped. */
+void SetFrameReuse( int enabled );
+int GetFrameReuse( void );
+
+/* Sets how many bytes of tiles the View plotters may keep in the tile
+   cache, so that views seen before come back without iterating. 0 turns
+   the cache off. */
+void SetTileCacheBudget( size_t bytes );
+
+/* Keeps the View plotters' tiles in the file at path too, so that they
+   survive a restart, and makes the tiles already in it available. NULL
+   stops using a file. Returns 0 if the file cannot be used, or is not a
+   tile cache file, which is then left untouched. */
+int SetTileCacheFile( const char* path );
+
+/* Selects the RENDER_ strategy used by subsequent F plots. */
+void SetRenderStrategy( int strategy );
+int GetRenderStrategy( void );
+
+/* Selects the APPROX_ method subsequent perturbed plots skip iterations
+   with. APPROX_SERIES is the default. */
+void SetDeepApproximation( int approximation );
+int GetDeepApproximation( void );
+
+/* Colors the most recent F plot again from its retained escape counts,
+   without iterating. Returns 0 if the retained plot is not w x h. */
+int RecolorF( void* buf, size_t elsize, int pitch, uint16_t w, uint16_t h, PlotFunction func );
+int RecolorSpans( void* buf, int pitch, uint16_t w, uint16_t h, const SpanColorizer* colorizer );
+
+/* Stops the render threads and frees their scratch space. */
+void ShutdownRender( void );
+
+/* Nonzero when c lies in the main cardioid or the period-2 bulb of the
+   Mandelbrot set, where every orbit stays bounded. */
+int MandelbrotInterior( double cx, double cy );
+
 void PlotJulia( complex double c, uint16_t* buf, uint16_t w, uint16_t h,
                 complex double upperleft, complex double lowerright, uint16_t* maxiter );
 void PlotMandelbrot( uint16_t* buf, uint16_t w, uint16_t h,
@@ -29,4 +255,38 @@ void PlotMandelbrotF( void* buf, size_t elsize, int pitch, uint16_t w, uint16_t
                      complex double upperleft, complex double lowerright, uint16_t* maxiter,
                      PlotFunction func );
 
+/* The same plots, colored a span at a time. The F plotters are adapters
+   over these that call their PlotFunction for each pixel of a span. */
+void PlotJuliaSpans( complex double c, void* buf, int pitch, uint16_t w, uint16_t h,
+                     complex double upperleft, complex double lowerright, uint16_t* maxiter,
+                     const SpanColorizer* colorizer );
+
+void PlotMandelbrotSpans( void* buf, int pitch, uint16_t w, uint16_t h,
+                          complex double upperleft, complex double lowerright, uint16_t* maxiter,
+                          const SpanColorizer* colorizer );
+
+/* Plots of a FractalView, colored a span at a time. Julia sets take c to
+   high precision, for views too deep for doubles. Return 0 if out of
+   memory, with nothing plotted. */
+int PlotJuliaView( const FractalPoint* c, void* buf, int pitch, uint16_t w, uint16_t h,
+                   const FractalView* view, uint16_t* maxiter, const SpanColorizer* colorizer );
+
+int PlotMandelbrotView( void* buf, int pitch, uint16_t w, uint16_t h,
+                        const FractalView* view, uint16_t* maxiter, const SpanColorizer* colorizer );
+
+/* Fast, approximate plots of a view for zooming continuously, in the
+   manner of XaoS. Each column and row is moved onto the nearest column
+   or row of the last plot within tolerance pixels, whose counts carry
+   over, and only the rest are iterated. Every pixel is exact for the
+   point it sits at, but points may be up to tolerance pixels off the
+   view's grid. Plot the view normally once it stops moving to refine.
+   Return 0 if out of memory, with nothing plotted. */
+int PlotJuliaRealtime( const FractalPoint* c, void* buf, int pitch, uint16_t w, uint16_t h,
+                       const FractalView* view, uint16_t* maxiter, double tolerance,
+                       const SpanColorizer* colorizer );
+
+int PlotMandelbrotRealtime( void* buf, int pitch, uint16_t w, uint16_t h,
+                            const FractalView* view, uint16_t* maxiter, double tolerance,
+                            const SpanColorizer* colorizer );
+
 #endif
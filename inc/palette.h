@@ -0,0 +1,36 @@
+/*
+
+    Definition file for precomputed color palettes.
+
+*/
+
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include "stdint.h"
+#include "SDL.h"
+
+#define PAL_LINEAR 0
+#define PAL_LOG 1
+
+/* Packed colors for every escape count from 0 to maxiter, in the pixel
+   format the palette was last built for. */
+typedef struct _Palette
+{
+    Uint32* lut;
+    int mode;
+    Uint32 format;
+    Uint16 maxiter;
+} PAL_Palette;
+
+PAL_Palette* PAL_CreatePalette( void );
+int PAL_UpdatePalette( PAL_Palette* pal, SDL_PixelFormat* fmt, Uint16 maxiter, int mode );
+void PAL_DestroyPalette( PAL_Palette* pal );
+
+/* A SpanFunction coloring 32-bit pixels from the PAL_Palette in userdata.
+   Given smooth counts, escaped pixels are shaded between the colors of
+   the two counts either side of theirs. */
+void PAL_ColorSpan( const uint16_t* iterations, const float* smooth, int count,
+                    void* dst, void* userdata );
+
+#endif
@@ -0,0 +1,146 @@
+/*
+
+    Definition file for perturbation rendering at deep zoom.
+
+*/
+
+#ifndef PERTURB_H
+#define PERTURB_H
+
+#include "bignum.h"
+#include "simd.h"
+
+/* Tells whether the work in hand has been given up on, so that the long
+   serial steps below can stop early. */
+typedef int (*PTB_CancelFunction)( void* userdata );
+
+/* The orbit of one reference point, computed in high precision and kept
+   rounded to doubles. For the Mandelbrot set the reference point is c and
+   the orbit starts at 0; for a Julia set it is the starting z, and c is
+   (cre, cim). Either way, (cx, cy) is c rounded to doubles. zx[n], zy[n]
+   is the orbit after n iterations, for n below length, which stops at
+   maxiter or one past the point the orbit escapes. The last z is kept in
+   high precision so a raised maxiter can carry on. */
+typedef struct _Reference
+{
+    int julia;
+    BIG_Number re, im;
+    BIG_Number cre, cim;
+    double cx, cy;
+    int limbs;
+    uint16_t maxiter;
+    int escaped;
+    int length;
+    double* zx;
+    double* zy;
+    BIG_Number lastx, lasty;
+} PTB_Reference;
+
+PTB_Reference* PTB_CreateReference( void );
+void PTB_DestroyReference( PTB_Reference* reference );
+
+/* Makes reference the orbit of point (re, im) out to maxiter, to limbs
+   limbs of precision, with c at (cre, cim) for a Julia set. An orbit
+   already computed for the same point to at least as many limbs is kept,
+   and extended if maxiter went up. Returns 0 if out of memory, or if
+   cancelled, which is asked with userdata before every iteration;
+   cancelled may be NULL. An orbit cut short is carried on by the next
+   call for the same point. */
+int PTB_ComputeReference( PTB_Reference* reference, int julia, const BIG_Number* re,
+                          const BIG_Number* im, const BIG_Number* cre, const BIG_Number* cim,
+                          uint16_t maxiter, int limbs, PTB_CancelFunction cancelled,
+                          void* userdata );
+
+/* Pixels glitch when |z|^2 falls below this fraction of |Z|^2. */
+#define PTB_GLITCH_TOLERANCE 1e-6
+
+/* The most reference orbits a frame is rendered off. */
+#define PTB_MAX_REFERENCES 16
+
+/* Series approximation: after skip iterations, the offset of the z of a
+   pixel at offset (x, y) from the reference point is the polynomial with
+   complex coefficients re[n] + i im[n], n from 0, in u = (x + i y) / radius,
+   without a constant term. */
+typedef struct
+{
+    int skip;
+    double radius;
+    double re[3];
+    double im[3];
+} PTB_Series;
+
+/* The most probe pixels a series is checked against, and how far it may
+   stray from them, as a fraction of the distance between pixels. */
+#define PTB_SERIES_PROBES 32
+#define PTB_SERIES_TOLERANCE 1e-8
+
+/* Fits the series for the view around probes, the offsets of pixels
+   spread over it, pixelsize apart, for as long as it holds for all of
+   them, no pixel could escape, and before maxiter. Returns the iterations it
+   skips. */
+int PTB_ComputeSeries( PTB_Series* series, const PTB_Reference* reference, const double* probex,
+                       const double* probey, int probes, double pixelsize, uint16_t maxiter );
+
+/* Queues the pixel at offset (x, y) from the reference point, in c for
+   the Mandelbrot set and in its starting z for a Julia set, to be
+   iterated as PTB_RunBatch expects. With a series, it starts after the
+   series' iterations; series may be NULL. */
+void PTB_PushPixel( SIMD_Batch* batch, const PTB_Series* series, int julia, double x, double y,
+                    uint32_t index );
+
+/* A linear map that carries an offset d and pixel offset dc 2^level
+   iterations on from orbit position k as a d + b dc, valid while |d| is
+   below radius. */
+typedef struct
+{
+    double ax, ay;
+    double bx, by;
+    double radius;
+} PTB_Step;
+
+/* Bilinear approximation: maps step[level][j] start at orbit position
+   1 + j 2^level, and those of each level merge pairs of the level below. */
+#define PTB_BLA_LEVELS 17
+#define PTB_BLA_EPSILON 0x1p-53
+
+typedef struct
+{
+    int levels;
+    int count[PTB_BLA_LEVELS];
+    PTB_Step* step[PTB_BLA_LEVELS];
+    PTB_Step* storage;
+    int capacity;
+} PTB_Table;
+
+PTB_Table* PTB_CreateTable( void );
+void PTB_DestroyTable( PTB_Table* table );
+
+/* Builds the table over the reference orbit for pixels up to radius from
+   the reference point. Returns 0 if out of memory, or if cancelled, which
+   is asked before every level; cancelled may be NULL. */
+int PTB_BuildTable( PTB_Table* table, const PTB_Reference* reference, double radius,
+                    PTB_CancelFunction cancelled, void* userdata );
+
+/* As PTB_RunBatch, but each pixel jumps along the table wherever its
+   offset is small enough, and Mandelbrot pixels rebase onto the start of
+   the orbit where their z comes closer to 0 than to the orbit's, or the
+   orbit ends, so they need no glitch detection. The iterations jumped
+   over are added to skipped, and the rebases to rebases. */
+void PTB_RunBatchBLA( const PTB_Reference* reference, const PTB_Table* table, SIMD_Batch* batch,
+                      uint16_t max, int glitches, SIMD_BatchOutput* out, SIMD_BatchStats* stats,
+                      uint64_t* skipped, uint64_t* rebases );
+
+/* Iterates and empties a batch of pixels off the reference orbit. Each
+   pixel's z and c are given as their offsets from the orbit's after iter
+   iterations: for the Mandelbrot set, z is zero at iteration 1 and c is
+   the pixel's offset from the reference point; for a Julia set, z is the
+   pixel's offset at iteration 1 and c is zero. Only the offsets are
+   iterated, in doubles. The output holds the pixels' own final z. With
+   glitches set, pixels that glitch get a count of 0 instead. Pixels that
+   outlive an escaped reference orbit fall back to iterating their own z
+   in plain doubles, with none of the view's precision, and so may come
+   out wrong: they are few, but can be off by hundreds of iterations. */
+void PTB_RunBatch( const PTB_Reference* reference, SIMD_Batch* batch, uint16_t max, int glitches,
+                   SIMD_BatchOutput* out, SIMD_BatchStats* stats );
+
+#endif
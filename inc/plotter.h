@@ -0,0 +1,72 @@
+/*
+
+    Definition file for the background plotter.
+
+*/
+
+#ifndef PLOTTER_H
+#define PLOTTER_H
+
+#include "SDL.h"
+#include "fractals.h"
+
+/* Columns and rows of real-time plots may be this many pixels off. */
+#define PLT_REALTIME_TOLERANCE 0.5
+
+/* What to plot. The palette is built for format from maxiter and the
+   PAL_ mode. With progressive set, coarse passes are shown first. With
+   realtime set, a single approximate pass is plotted for continuous
+   zooming. With recolor set, only the colors changed since the last
+   request. */
+typedef struct
+{
+    int julia;
+    FractalPoint c;
+    FractalView view;
+    uint16_t maxiter;
+    int palette_mode;
+    Uint32 format;
+    int strategy;
+    int periodicity;
+    int approximation;
+    int progressive;
+    int realtime;
+    int recolor;
+} PLT_Request;
+
+/* A finished pass of the latest request. Pixel (i, j) of the pass covers
+   window pixels (i * 2^shift - offx, j * 2^shift - offy) onwards, so a
+   shift of 0 is the full frame, and recolor is set if the pass only
+   recolored the last one. The stats are the renderer's for the pass, and
+   the times are from the request to the first and to this pass. */
+typedef struct
+{
+    Uint32* pixels;
+    int pitch;
+    int w, h;
+    int shift;
+    int offx, offy;
+    int recolor;
+    RenderStats stats;
+    double firstms, passms;
+} PLT_Pass;
+
+typedef struct _Plotter PLT_Plotter;
+
+/* Starts a thread plotting w x h frames. Every finished pass is announced
+   with an SDL user event of type PLT_GetEventType. */
+PLT_Plotter* PLT_CreatePlotter( uint16_t w, uint16_t h, int previewshift );
+void PLT_DestroyPlotter( PLT_Plotter* plotter );
+Uint32 PLT_GetEventType( void );
+
+/* Replaces whatever the plotter was doing with request. A render in
+   progress, or taken up but not yet started, is cancelled before its next
+   tile. */
+void PLT_Submit( PLT_Plotter* plotter, const PLT_Request* request );
+
+/* Fills in the newest finished pass of the latest request and holds it
+   until PLT_UnlockPass, or returns 0 if there is none to show. */
+int PLT_LockPass( PLT_Plotter* plotter, PLT_Pass* pass );
+void PLT_UnlockPass( PLT_Plotter* plotter );
+
+#endif
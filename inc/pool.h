@@ -0,0 +1,23 @@
+/*
+
+    Definition file for the persistent worker pool.
+
+*/
+
+#ifndef POOL_H
+#define POOL_H
+
+#include "SDL.h"
+
+/* Called once for every task index in [0, tasks). worker identifies the
+   calling thread in [0, threads), so tasks can keep per-worker scratch. */
+typedef void (*POOL_TaskFunction)( int task, int worker, void* data );
+
+typedef struct _Pool POOL_Pool;
+
+POOL_Pool* POOL_CreatePool( int threads );
+int POOL_GetThreadCount( POOL_Pool* pool );
+void POOL_Run( POOL_Pool* pool, int tasks, POOL_TaskFunction func, void* data );
+void POOL_DestroyPool( POOL_Pool* pool );
+
+#endif
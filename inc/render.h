@@ -0,0 +1,159 @@
+/*
+
+    Definition file for the tiled, multithreaded renderer behind the
+    F plotting functions.
+
+*/
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "fractals.h"
+
+/* Tiles are square blocks of this many pixels on a side. */
+#define RND_TILE_SIZE 64
+
+/* Periodicity checks treat orbits as cyclic when they return within this
+   fraction of a pixel of an earlier point. */
+#define RND_CYCLE_TOLERANCE (1.0 / 1024)
+
+/* The version of the counts the renderer produces. Bump it whenever a
+   change to the kernels or the strategies changes any pixel's count,
+   final z or flags, so that tile cache files of older builds are started
+   over rather than served as exact. */
+#define RND_FORMAT_VERSION 2
+
+/* Tile data kept by the tile cache, in bytes, unless SetTileCacheBudget
+   says otherwise. */
+#define RND_CACHE_BUDGET (128 << 20)
+
+/* The most tile data a tile cache file may grow to, in bytes. */
+#define RND_CACHE_FILE_LIMIT ((size_t)1 << 30)
+
+/* Grid point n of a FractalView axis at the given level. The product
+   n * step is rounded before it is scaled by a power of two, which is
+   exact, so point 2n of level + 1 is bit for bit point n of level. */
+static inline double RND_GridPoint( double origin, double step, int level, int64_t n )
+{
+    return origin + ldexp( (double)n * step, -level );
+}
+
+/* One frame's worth of work. Pixel (i, j) sits at (xs[i], ys[j]) in the
+   complex plane, and pixelsize is the smaller spacing between pixels.
+   Julia pixels start z there with c fixed at (cx, cy), or (cre, cim) to
+   high precision, and Mandelbrot pixels start z at the origin with c
+   there. Colors are written a span at a time through
+   colorizer into buf, whose rows are pitch bytes apart.
+
+   If view is set, xs and ys must be its grid points. Tiles are then
+   aligned to the grid rather than to the frame, rendered whole even where
+   they stick out of the frame, and kept in the tile cache.
+
+   If perturb is set, xs and ys are offsets from the reference point
+   (refre, refim) instead, and pixels are iterated by perturbation off its
+   orbit, computed to limbs limbs of precision. If doubledouble is set,
+   xs and ys are offsets from the reference point as well, and pixels are
+   iterated in double-double arithmetic from the reference point plus
+   their offset. Neither kind of job has a view, and their frames are not
+   reused, since their offsets are only meaningful against their own
+   reference point.
+
+   The rest is filled in by RND_Render: strategy from the current render
+   strategy; approximation from the current deep approximation; cancel
+   from the generation set by SetRenderGeneration, or else from the
+   CancelRender calls made before it starts, so that the reference orbit,
+   its tables and the workers can tell when another comes in; reusecols
+   and reuserows map the frame's columns and rows to those of the previous
+   frame with exactly the same coordinate, or to -1; and the tiles form a
+   tilesx by tilesy block, whose first tile is grid tile (tx0, ty0) of a
+   view. */
+typedef struct
+{
+    int julia;
+    double cx, cy;
+    uint16_t w, h;
+    const double* xs;
+    const double* ys;
+    double pixelsize;
+    uint16_t maxiter;
+    const FractalView* view;
+    BIG_Number cre, cim;
+    int perturb;
+    int doubledouble;
+    BIG_Number refre, refim;
+    int limbs;
+
+    int strategy;
+    int approximation;
+    int cancel;
+    const int* reusecols;
+    const int* reuserows;
+    int tilesx, tilesy;
+    int64_t tx0, ty0;
+
+    void* buf;
+    int pitch;
+    SpanColorizer colorizer;
+} RND_Job;
+
+/* Results of a render, kept for recoloring and for reuse by the next
+   render. zx and zy hold the final z of pixels flagged RND_FRAME_HAVEZ;
+   pixels filled by a strategy, skipped by a test or stopped by the
+   periodicity check have none. Pixels flagged RND_FRAME_EXACT were
+   iterated or tested rather than filled, so their counts hold for any
+   frame with a pixel at the same point, except that a count of maxiter
+   without a z may come from the periodicity check, and so only holds at a
+   tolerance no tighter than cycletolerance, which is 0 with the check off.
+   smooth holds the fractional escape count, and is only worked out once
+   RND_GetSmooth asks for it. transient is set for the frame of a
+   PreviewView or a cancelled render, which is not kept as the previous
+   frame, and relative for that of a perturbed or double-double job, whose
+   xs and ys are offsets. */
+#define RND_FRAME_HAVEZ 1
+#define RND_FRAME_EXACT 2
+
+typedef struct
+{
+    uint16_t w, h;
+    int julia;
+    double cx, cy;
+    uint16_t maxiter;
+    double cycletolerance;
+    int transient;
+    int relative;
+    double* xs;
+    double* ys;
+    uint16_t* iterations;
+    float* smooth;
+    int smoothready;
+    double* zx;
+    double* zy;
+    uint8_t* flags;
+} RND_Frame;
+
+/* Renders the job into its buffer. Returns 0 if out of memory, in which
+   case nothing is drawn. A cancelled render returns 1, with its output
+   unfinished. */
+int RND_Render( RND_Job* job );
+
+/* Builds a colorizer whose spans call func for each pixel, for the
+   PlotFunction entry points. adapter must outlive the colorizer. */
+typedef struct
+{
+    PlotFunction func;
+    size_t elsize;
+} RND_PlotAdapter;
+
+void RND_AdaptPlotFunction( SpanColorizer* colorizer, RND_PlotAdapter* adapter,
+                            PlotFunction func, size_t elsize );
+
+/* Moves each of the w coordinates in xs and h in ys onto the nearest
+   column or row of the frame the next render reuses, if one lies within
+   xtolerance or ytolerance, so that its counts are carried over. No
+   column or row is used twice, so the axes stay in order. */
+void RND_SnapToFrame( double* xs, int w, double* ys, int h, double xtolerance, double ytolerance );
+
+/* The retained frame's smooth escape counts, or NULL without a frame. */
+const float* RND_GetSmooth( void );
+
+#endif
@@ -0,0 +1,81 @@
+/*
+
+    Definition file for the vectorized escape-time batch engine.
+
+*/
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "stdint.h"
+
+#define SIMD_LANES 4
+
+/* The AVX2 kernel is only built where doubles are evaluated in SSE registers,
+   so that its escape counts match the scalar kernel exactly. */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SIMD_AVX2_BUILT 1
+#else
+#define SIMD_AVX2_BUILT 0
+#endif
+
+/* Pixels waiting to be iterated, stored structure-of-arrays. A pixel starts
+   at z = (zx, zy) having already performed iter iterations, and its results
+   are written at index in the SIMD_BatchOutput arrays when SIMD_RunBatch
+   finishes it. */
+typedef struct _Batch
+{
+    int count, capacity;
+    double* zx;
+    double* zy;
+    double* cx;
+    double* cy;
+    uint16_t* iter;
+    uint32_t* index;
+} SIMD_Batch;
+
+/* Escape counts and the final value of z for each finished pixel. Unless
+   it is NULL, cycled is set to 1 for the pixels stopped by the
+   periodicity check, whose z is where the cycle was found rather than
+   the z after iter iterations, and left alone for the rest. */
+typedef struct _BatchOutput
+{
+    uint16_t* iter;
+    double* zx;
+    double* zy;
+    uint8_t* cycled;
+} SIMD_BatchOutput;
+
+/* Lane occupancy, counted per lane per iteration step, and the number of
+   pixels stopped early because their orbit was found to be periodic. */
+typedef struct _BatchStats
+{
+    uint64_t lanesteps;
+    uint64_t activesteps;
+    uint64_t cycles;
+} SIMD_BatchStats;
+
+int SIMD_HasAVX2( void );
+
+SIMD_Batch* SIMD_CreateBatch( int capacity );
+void SIMD_DestroyBatch( SIMD_Batch* batch );
+
+static inline void SIMD_PushPixel( SIMD_Batch* batch, double zx, double zy, double cx, double cy,
+                                   uint16_t iter, uint32_t index )
+{
+    int n = batch->count++;
+    batch->zx[n] = zx;
+    batch->zy[n] = zy;
+    batch->cx[n] = cx;
+    batch->cy[n] = cy;
+    batch->iter[n] = iter;
+    batch->index[n] = index;
+}
+
+/* Iterates and empties the batch. With a positive tolerance, an orbit that
+   returns within tolerance of an earlier point is taken to be periodic and
+   its pixel is given max at once. */
+void SIMD_RunBatch( SIMD_Batch* batch, uint16_t max, double tolerance,
+                    SIMD_BatchOutput* out, SIMD_BatchStats* stats );
+
+#endif
@@ -0,0 +1,69 @@
+/*
+
+    Definition file for the tile cache.
+
+*/
+
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include "stdlib.h"
+#include "stdint.h"
+
+/* Identifies one square tile of a FractalView grid. The grid is given by
+   its origin and level 0 spacing; tile (tx, ty) of a level covers grid
+   points tx * size to tx * size + size - 1 on the real axis, and the same
+   for ty on the imaginary axis. The four tiles (2tx + 0..1, 2ty + 0..1) of
+   the next level cover the same area, which makes the tiles a quadtree.
+   settings identifies the render settings the tile was made with. */
+typedef struct
+{
+    int settings;
+    int julia;
+    double cx, cy;
+    double re, im;
+    double dre, dim;
+    uint16_t maxiter;
+    int level;
+    int64_t tx, ty;
+} CACHE_Key;
+
+typedef struct _TileCache CACHE_Cache;
+
+/* A cache of tiles of pixels pixels each, holding at most budget bytes of
+   tile data. Lookups and inserts may come from any thread. */
+CACHE_Cache* CACHE_CreateCache( int pixels, size_t budget );
+void CACHE_DestroyCache( CACHE_Cache* cache );
+
+/* Changes the budget, evicting the least recently used tiles to meet it. */
+void CACHE_SetBudget( CACHE_Cache* cache, size_t budget );
+void CACHE_Clear( CACHE_Cache* cache );
+
+/* Keeps every tile inserted from now on in an append-only file at path
+   as well, up to limit bytes, and makes the tiles already in the file
+   available. format is formatsize bytes describing what the caller's
+   tiles mean, beyond their layout. The file is started over if it was
+   written by another version, with another tile layout or with another
+   format. Returns 0 if the file cannot be used, or is there but is not a
+   tile cache file, in which case it is left as it is and the cache
+   carries on in memory only. */
+int CACHE_AttachFile( CACHE_Cache* cache, const char* path, size_t limit, const void* format,
+                      size_t formatsize );
+void CACHE_DetachFile( CACHE_Cache* cache );
+
+/* Where CACHE_Lookup found a tile. */
+#define CACHE_MISS 0
+#define CACHE_MEMORY 1
+#define CACHE_FILE 2
+
+/* Copies a tile's escape counts, RND_FRAME_ flags and final z values into
+   the arrays given, which must hold a tile each. A tile found only in the
+   file is paged in from it and kept in memory again. */
+int CACHE_Lookup( CACHE_Cache* cache, const CACHE_Key* key, uint16_t* iterations,
+                  uint8_t* flags, double* zx, double* zy );
+
+/* Stores a tile, replacing any tile cached under the same key. */
+void CACHE_Insert( CACHE_Cache* cache, const CACHE_Key* key, const uint16_t* iterations,
+                   const uint8_t* flags, const double* zx, const double* zy );
+
+#endif
@@ -0,0 +1,269 @@
+/*
+
+    Implementation file for high-precision fixed-point numbers.
+    Numbers are two's complement over the whole limb array, so addition
+    and subtraction are a single carry chain from the last limb. Products
+    are formed from the magnitudes by schoolbook multiplication, keeping
+    one limb below the precision asked for to carry from.
+
+*/
+
+#include "string.h"
+#include "math.h"
+#include "bignum.h"
+
+static int isNegative( const BIG_Number* a )
+{
+    return (a->limb[0] & 0x80000000u) != 0;
+}
+
+static void negate( BIG_Number* r, const BIG_Number* a )
+{
+    uint64_t carry = 1;
+    int i;
+    for ( i = BIG_LIMBS - 1; i >= 0; i-- )
+    {
+        uint64_t sum = (uint64_t)(uint32_t)~a->limb[i] + carry;
+        r->limb[i] = (uint32_t)sum;
+        carry = sum >> 32;
+    }
+}
+
+void BIG_Zero( BIG_Number* r )
+{
+    memset( r, 0, sizeof(BIG_Number) );
+}
+
+void BIG_FromDouble( BIG_Number* r, double d )
+{
+    BIG_Zero( r );
+    if ( d == 0 || !isfinite( d ) )
+    {
+        return;
+    }
+
+    /* d is m * 2^shift scaled by the resolution, for a 53-bit integer m. */
+    int exponent;
+    double fraction = frexp( fabs( d ), &exponent );
+    uint64_t m = (uint64_t)ldexp( fraction, 53 );
+    int shift = exponent - 53 + 32 * (BIG_LIMBS - 1);
+    if ( shift < 0 )
+    {
+        m = shift > -64 ? m >> -shift : 0;
+        shift = 0;
+    }
+
+    int limb = shift / 32;
+    int bits = shift % 32;
+    uint64_t low = m << bits;
+    uint64_t high = bits ? m >> (64 - bits) : 0;
+    uint32_t parts[3] = { (uint32_t)low, (uint32_t)(low >> 32), (uint32_t)high };
+
+    int k;
+    for ( k = 0; k < 3 && limb + k < BIG_LIMBS; k++ )
+    {
+        r->limb[BIG_LIMBS - 1 - limb - k] = parts[k];
+    }
+
+    if ( d < 0 )
+    {
+        negate( r, r );
+    }
+}
+
+double BIG_ToDouble( const BIG_Number* a )
+{
+    BIG_Number magnitude = *a;
+    int negative = isNegative( a );
+    if ( negative )
+    {
+        negate( &magnitude, a );
+    }
+
+    int k = 0;
+    while ( k < BIG_LIMBS && !magnitude.limb[k] )
+    {
+        k++;
+    }
+    if ( k == BIG_LIMBS )
+    {
+        return 0;
+    }
+
+    /* Three limbs are more than a double holds. */
+    double d = ldexp( (double)magnitude.limb[k], -32 * k );
+    if ( k + 1 < BIG_LIMBS )
+    {
+        d += ldexp( (double)magnitude.limb[k + 1], -32 * (k + 1) );
+    }
+    if ( k + 2 < BIG_LIMBS )
+    {
+        d += ldexp( (double)magnitude.limb[k + 2], -32 * (k + 2) );
+    }
+    return negative ? -d : d;
+}
+
+int BIG_IsZero( const BIG_Number* a )
+{
+    int i;
+    for ( i = 0; i < BIG_LIMBS; i++ )
+    {
+        if ( a->limb[i] )
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int BIG_Equal( const BIG_Number* a, const BIG_Number* b )
+{
+    return memcmp( a->limb, b->limb, sizeof(a->limb) ) == 0;
+}
+
+void BIG_Add( BIG_Number* r, const BIG_Number* a, const BIG_Number* b )
+{
+    uint64_t carry = 0;
+    int i;
+    for ( i = BIG_LIMBS - 1; i >= 0; i-- )
+    {
+        uint64_t sum = (uint64_t)a->limb[i] + b->limb[i] + carry;
+        r->limb[i] = (uint32_t)sum;
+        carry = sum >> 32;
+    }
+}
+
+void BIG_Sub( BIG_Number* r, const BIG_Number* a, const BIG_Number* b )
+{
+    uint64_t carry = 1;
+    int i;
+    for ( i = BIG_LIMBS - 1; i >= 0; i-- )
+    {
+        uint64_t sum = (uint64_t)a->limb[i] + (uint32_t)~b->limb[i] + carry;
+        r->limb[i] = (uint32_t)sum;
+        carry = sum >> 32;
+    }
+}
+
+void BIG_Ldexp( BIG_Number* r, const BIG_Number* a, int exponent )
+{
+    BIG_Number src = *a;
+    uint32_t fill = isNegative( a ) ? 0xffffffffu : 0;
+    int right = exponent < 0;
+    int shift = right ? -exponent : exponent;
+    int limbs = shift / 32;
+    int bits = shift % 32;
+
+    int i;
+    for ( i = 0; i < BIG_LIMBS; i++ )
+    {
+        uint32_t whole, next;
+        if ( right )
+        {
+            int j = i - limbs;
+            whole = j >= 0 ? src.limb[j] : fill;
+            next = j - 1 >= 0 ? src.limb[j - 1] : fill;
+            r->limb[i] = bits ? (whole >> bits) | (next << (32 - bits)) : whole;
+        }
+        else
+        {
+            int j = i + limbs;
+            whole = j < BIG_LIMBS ? src.limb[j] : 0;
+            next = j + 1 < BIG_LIMBS ? src.limb[j + 1] : 0;
+            r->limb[i] = bits ? (whole << bits) | (next >> (32 - bits)) : whole;
+        }
+    }
+}
+
+void BIG_Mul( BIG_Number* r, const BIG_Number* a, const BIG_Number* b, int limbs )
+{
+    if ( limbs > BIG_LIMBS )
+    {
+        limbs = BIG_LIMBS;
+    }
+
+    BIG_Number x = *a;
+    BIG_Number y = *b;
+    int negative = isNegative( a ) != isNegative( b );
+    if ( isNegative( a ) )
+    {
+        negate( &x, a );
+    }
+    if ( isNegative( b ) )
+    {
+        negate( &y, b );
+    }
+
+    /* t[p] has weight 2^(-32 (p - 1)), so limb k of the product is
+       t[k + 1]. Terms below t[limbs + 1] are left out. */
+    uint32_t t[BIG_LIMBS + 2];
+    memset( t, 0, sizeof(t) );
+
+    int i, j;
+    for ( i = limbs - 1; i >= 0; i-- )
+    {
+        uint64_t carry = 0;
+        int last = limbs - i < limbs - 1 ? limbs - i : limbs - 1;
+        for ( j = last; j >= 0; j-- )
+        {
+            uint64_t cur = (uint64_t)x.limb[i] * y.limb[j] + t[i + j + 1] + carry;
+            t[i + j + 1] = (uint32_t)cur;
+            carry = cur >> 32;
+        }
+        t[i] = (uint32_t)carry;
+    }
+
+    for ( i = 0; i < BIG_LIMBS; i++ )
+    {
+        r->limb[i] = i < limbs ? t[i + 1] : 0;
+    }
+    if ( negative )
+    {
+        negate( r, r );
+    }
+}
+
+/* r = a * m for the magnitude a. */
+static void mulLimb( BIG_Number* r, const BIG_Number* a, uint32_t m )
+{
+    uint64_t carry = 0;
+    int i;
+    for ( i = BIG_LIMBS - 1; i >= 0; i-- )
+    {
+        uint64_t cur = (uint64_t)a->limb[i] * m + carry;
+        r->limb[i] = (uint32_t)cur;
+        carry = cur >> 32;
+    }
+}
+
+void BIG_MulInt( BIG_Number* r, const BIG_Number* a, int64_t n )
+{
+    BIG_Number x = *a;
+    int negative = isNegative( a ) != (n < 0);
+    if ( isNegative( a ) )
+    {
+        negate( &x, a );
+    }
+    uint64_t m = n < 0 ? 0 - (uint64_t)n : (uint64_t)n;
+
+    /* The high half of n multiplies a shifted up a limb. */
+    BIG_Number low, high;
+    mulLimb( &low, &x, (uint32_t)m );
+    mulLimb( &high, &x, (uint32_t)(m >> 32) );
+    BIG_Ldexp( &high, &high, 32 );
+    BIG_Add( r, &low, &high );
+    if ( negative )
+    {
+        negate( r, r );
+    }
+}
+
+int BIG_LimbsFor( int bits )
+{
+    int limbs = 1 + (bits + 31) / 32;
+    if ( limbs < 2 )
+    {
+        return 2;
+    }
+    return limbs < BIG_LIMBS ? limbs : BIG_LIMBS;
+}
@@ -0,0 +1,460 @@
+/*
+
+    Implementation file for double-double escape-time iteration.
+    Between the zooms doubles can resolve and those that call for
+    perturbation, pixels are iterated directly in double-double numbers,
+    each the unevaluated sum of two doubles. Sums are carried with
+    Knuth's two-sum, which gives the rounding error of a double addition
+    exactly, and products with a fused multiply-add, which gives that of a
+    double product exactly, so every operation is good to about 106 bits
+    for a handful of double operations, with no reference orbit and so no
+    glitches.
+
+    The arithmetic follows Bailey's QD library, without the corrections
+    that only matter for relative precision under cancellation: the
+    orbits stay within a radius of 2, so it is the absolute error that
+    counts.
+
+*/
+
+#include "math.h"
+#include "ddouble.h"
+
+#if SIMD_AVX2_BUILT
+#include "immintrin.h"
+#endif
+
+/* a + b exactly, for any a and b. */
+static inline DD_Number twoSum( double a, double b )
+{
+    DD_Number r;
+    r.hi = a + b;
+    double bb = r.hi - a;
+    r.lo = (a - (r.hi - bb)) + (b - bb);
+    return r;
+}
+
+/* a + b exactly, as long as |a| >= |b|. */
+static inline DD_Number quickTwoSum( double a, double b )
+{
+    DD_Number r;
+    r.hi = a + b;
+    r.lo = b - (r.hi - a);
+    return r;
+}
+
+static inline DD_Number add( DD_Number a, DD_Number b )
+{
+    DD_Number s = twoSum( a.hi, b.hi );
+    return quickTwoSum( s.hi, s.lo + (a.lo + b.lo) );
+}
+
+static inline DD_Number mul( DD_Number a, DD_Number b )
+{
+    double p = a.hi * b.hi;
+    double e = fma( a.hi, b.hi, -p );
+    return quickTwoSum( p, e + (a.hi * b.lo + a.lo * b.hi) );
+}
+
+static inline DD_Number sqr( DD_Number a )
+{
+    double p = a.hi * a.hi;
+    double e = fma( a.hi, a.hi, -p );
+    return quickTwoSum( p, e + (a.hi + a.hi) * a.lo );
+}
+
+/* How far apart a and b are, to a double. */
+static inline double distance( DD_Number a, DD_Number b )
+{
+    return fabs( (a.hi - b.hi) + (a.lo - b.lo) );
+}
+
+void DD_FromBig( DD_Number* r, const BIG_Number* a )
+{
+    BIG_Number rest;
+    double hi = BIG_ToDouble( a );
+    BIG_FromDouble( &rest, hi );
+    BIG_Sub( &rest, a, &rest );
+    *r = quickTwoSum( hi, BIG_ToDouble( &rest ) );
+}
+
+/* The starting z and c of pixel n of the batch. */
+static void startPixel( const DD_Base* base, const SIMD_Batch* batch, int n,
+                        DD_Number* zx, DD_Number* zy, DD_Number* cx, DD_Number* cy )
+{
+    DD_Number offset = { 0, 0 };
+    offset.hi = batch->zx[n];
+    *zx = add( base->zx, offset );
+    offset.hi = batch->zy[n];
+    *zy = add( base->zy, offset );
+    offset.hi = batch->cx[n];
+    *cx = add( base->cx, offset );
+    offset.hi = batch->cy[n];
+    *cy = add( base->cy, offset );
+}
+
+static void runBatchScalar( const DD_Base* base, SIMD_Batch* batch, uint16_t max, double tolerance,
+                            SIMD_BatchOutput* out, SIMD_BatchStats* stats )
+{
+    uint64_t steps = 0;
+    uint64_t cycles = 0;
+
+    int n;
+    for ( n = 0; n < batch->count; n++ )
+    {
+        DD_Number zx, zy, cx, cy;
+        startPixel( base, batch, n, &zx, &zy, &cx, &cy );
+        uint16_t iterations = batch->iter[n];
+        int cycled = 0;
+
+        /* Brent's cycle detection, as in the batch engine. */
+        DD_Number savedx = zx;
+        DD_Number savedy = zy;
+        uint32_t window = 1;
+        uint32_t nextsave = iterations + window;
+
+        while ( zx.hi * zx.hi + zy.hi * zy.hi < 2 * 2 && iterations < max )
+        {
+            DD_Number x2 = sqr( zx );
+            DD_Number y2 = sqr( zy );
+            DD_Number xy = mul( zx, zy );
+            y2.hi = -y2.hi;
+            y2.lo = -y2.lo;
+            xy.hi = xy.hi + xy.hi;
+            xy.lo = xy.lo + xy.lo;
+            zx = add( add( x2, y2 ), cx );
+            zy = add( xy, cy );
+            iterations++;
+            steps++;
+
+            if ( tolerance > 0 )
+            {
+                if ( distance( zx, savedx ) < tolerance && distance( zy, savedy ) < tolerance )
+                {
+                    iterations = max;
+                    cycles++;
+                    cycled = 1;
+                    break;
+                }
+                if ( iterations == nextsave )
+                {
+                    savedx = zx;
+                    savedy = zy;
+                    window *= 2;
+                    nextsave = iterations + window;
+                }
+            }
+        }
+
+        uint32_t index = batch->index[n];
+        out->iter[index] = iterations;
+        if ( cycled && out->cycled )
+        {
+            out->cycled[index] = 1;
+        }
+        out->zx[index] = zx.hi;
+        out->zy[index] = zy.hi;
+    }
+
+    stats->lanesteps += steps;
+    stats->activesteps += steps;
+    stats->cycles += cycles;
+}
+
+#if SIMD_AVX2_BUILT
+
+static int hasFMA( void )
+{
+    static int checked = 0;
+    static int supported = 0;
+    if ( !checked )
+    {
+        __builtin_cpu_init( );
+        supported = __builtin_cpu_supports( "fma" ) ? 1 : 0;
+        checked = 1;
+    }
+    return supported;
+}
+
+/* A double-double in each lane. */
+typedef struct
+{
+    __m256d hi, lo;
+} DD_Lanes;
+
+/* The lanes' numbers between runs of vector steps. */
+typedef struct
+{
+    double hi[SIMD_LANES];
+    double lo[SIMD_LANES];
+} DD_LaneStore;
+
+__attribute__((target("avx2,fma")))
+static inline DD_Lanes twoSum4( __m256d a, __m256d b )
+{
+    DD_Lanes r;
+    r.hi = _mm256_add_pd( a, b );
+    __m256d bb = _mm256_sub_pd( r.hi, a );
+    r.lo = _mm256_add_pd( _mm256_sub_pd( a, _mm256_sub_pd( r.hi, bb ) ), _mm256_sub_pd( b, bb ) );
+    return r;
+}
+
+__attribute__((target("avx2,fma")))
+static inline DD_Lanes quickTwoSum4( __m256d a, __m256d b )
+{
+    DD_Lanes r;
+    r.hi = _mm256_add_pd( a, b );
+    r.lo = _mm256_sub_pd( b, _mm256_sub_pd( r.hi, a ) );
+    return r;
+}
+
+__attribute__((target("avx2,fma")))
+static inline DD_Lanes add4( DD_Lanes a, DD_Lanes b )
+{
+    DD_Lanes s = twoSum4( a.hi, b.hi );
+    return quickTwoSum4( s.hi, _mm256_add_pd( s.lo, _mm256_add_pd( a.lo, b.lo ) ) );
+}
+
+__attribute__((target("avx2,fma")))
+static inline DD_Lanes mul4( DD_Lanes a, DD_Lanes b )
+{
+    __m256d p = _mm256_mul_pd( a.hi, b.hi );
+    __m256d e = _mm256_fmsub_pd( a.hi, b.hi, p );
+    __m256d cross = _mm256_add_pd( _mm256_mul_pd( a.hi, b.lo ), _mm256_mul_pd( a.lo, b.hi ) );
+    return quickTwoSum4( p, _mm256_add_pd( e, cross ) );
+}
+
+__attribute__((target("avx2,fma")))
+static inline DD_Lanes sqr4( DD_Lanes a )
+{
+    __m256d p = _mm256_mul_pd( a.hi, a.hi );
+    __m256d e = _mm256_fmsub_pd( a.hi, a.hi, p );
+    __m256d cross = _mm256_mul_pd( _mm256_add_pd( a.hi, a.hi ), a.lo );
+    return quickTwoSum4( p, _mm256_add_pd( e, cross ) );
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256d distance4( DD_Lanes a, DD_Lanes b, __m256d sign )
+{
+    __m256d d = _mm256_add_pd( _mm256_sub_pd( a.hi, b.hi ), _mm256_sub_pd( a.lo, b.lo ) );
+    return _mm256_andnot_pd( sign, d );
+}
+
+__attribute__((target("avx2,fma")))
+static inline DD_Lanes load4( const DD_LaneStore* store )
+{
+    DD_Lanes r;
+    r.hi = _mm256_loadu_pd( store->hi );
+    r.lo = _mm256_loadu_pd( store->lo );
+    return r;
+}
+
+__attribute__((target("avx2,fma")))
+static inline void store4( DD_LaneStore* store, DD_Lanes a )
+{
+    _mm256_storeu_pd( store->hi, a.hi );
+    _mm256_storeu_pd( store->lo, a.lo );
+}
+
+__attribute__((target("avx2,fma")))
+static inline DD_Lanes blend4( DD_Lanes a, DD_Lanes b, __m256d mask )
+{
+    DD_Lanes r;
+    r.hi = _mm256_blendv_pd( a.hi, b.hi, mask );
+    r.lo = _mm256_blendv_pd( a.lo, b.lo, mask );
+    return r;
+}
+
+static void setLane( DD_LaneStore* store, int lane, DD_Number a )
+{
+    store->hi[lane] = a.hi;
+    store->lo[lane] = a.lo;
+}
+
+/* As the batch engine's AVX2 kernel, each lane follows the scalar kernel
+   exactly. The fused multiply-adds give the same exact product errors as
+   fma, so the counts match bit for bit. */
+__attribute__((target("avx2,fma")))
+static void runBatchAVX2( const DD_Base* base, SIMD_Batch* batch, uint16_t max, double tolerance,
+                          SIMD_BatchOutput* out, SIMD_BatchStats* stats )
+{
+    DD_LaneStore lzx, lzy, lcx, lcy, lsavedx, lsavedy;
+    int64_t lit[SIMD_LANES], lwindow[SIMD_LANES], lnextsave[SIMD_LANES];
+    int64_t occupied[SIMD_LANES];
+    int slot[SIMD_LANES];
+
+    const DD_Number zero = { 0, 0 };
+    const __m256d four = _mm256_set1_pd( 2 * 2 );
+    const __m256d sign = _mm256_set1_pd( -0.0 );
+    const __m256d tol = _mm256_set1_pd( tolerance );
+    const __m256i limit = _mm256_set1_epi64x( max );
+    const int periodic = tolerance > 0;
+
+    uint64_t lanesteps = 0;
+    uint64_t activesteps = 0;
+    uint64_t cycles = 0;
+    int next = 0;
+    int lane;
+
+    for ( lane = 0; lane < SIMD_LANES; lane++ )
+    {
+        setLane( &lzx, lane, zero );
+        setLane( &lzy, lane, zero );
+        setLane( &lcx, lane, zero );
+        setLane( &lcy, lane, zero );
+        setLane( &lsavedx, lane, zero );
+        setLane( &lsavedy, lane, zero );
+        lit[lane] = max;
+        lwindow[lane] = lnextsave[lane] = 0;
+        slot[lane] = -1;
+    }
+
+    for (;;)
+    {
+        int live = 0;
+        for ( lane = 0; lane < SIMD_LANES; lane++ )
+        {
+            for (;;)
+            {
+                if ( slot[lane] >= 0 )
+                {
+                    if ( lzx.hi[lane] * lzx.hi[lane] + lzy.hi[lane] * lzy.hi[lane] < 2 * 2
+                         && lit[lane] < max )
+                    {
+                        live |= 1 << lane;
+                        break;
+                    }
+                    uint32_t index = batch->index[slot[lane]];
+                    out->iter[index] = (uint16_t)lit[lane];
+                    out->zx[index] = lzx.hi[lane];
+                    out->zy[index] = lzy.hi[lane];
+                    slot[lane] = -1;
+                }
+
+                if ( next >= batch->count )
+                {
+                    break;
+                }
+
+                DD_Number zx, zy, cx, cy;
+                startPixel( base, batch, next, &zx, &zy, &cx, &cy );
+                setLane( &lzx, lane, zx );
+                setLane( &lzy, lane, zy );
+                setLane( &lcx, lane, cx );
+                setLane( &lcy, lane, cy );
+                setLane( &lsavedx, lane, zx );
+                setLane( &lsavedy, lane, zy );
+                lit[lane] = batch->iter[next];
+                lwindow[lane] = 1;
+                lnextsave[lane] = lit[lane] + 1;
+                slot[lane] = next++;
+            }
+            occupied[lane] = slot[lane] >= 0 ? -1 : 0;
+        }
+
+        if ( !live )
+        {
+            break;
+        }
+
+        DD_Lanes zx = load4( &lzx );
+        DD_Lanes zy = load4( &lzy );
+        DD_Lanes cx = load4( &lcx );
+        DD_Lanes cy = load4( &lcy );
+        DD_Lanes savedx = load4( &lsavedx );
+        DD_Lanes savedy = load4( &lsavedy );
+        __m256i iterations = _mm256_loadu_si256( (const __m256i*)lit );
+        __m256i window = _mm256_loadu_si256( (const __m256i*)lwindow );
+        __m256i nextsave = _mm256_loadu_si256( (const __m256i*)lnextsave );
+        __m256d active = _mm256_castsi256_pd( _mm256_loadu_si256( (const __m256i*)occupied ) );
+
+        int mask = live;
+        while ( mask == live )
+        {
+            DD_Lanes x2 = sqr4( zx );
+            DD_Lanes y2 = sqr4( zy );
+            DD_Lanes xy = mul4( zx, zy );
+            y2.hi = _mm256_xor_pd( y2.hi, sign );
+            y2.lo = _mm256_xor_pd( y2.lo, sign );
+            xy.hi = _mm256_add_pd( xy.hi, xy.hi );
+            xy.lo = _mm256_add_pd( xy.lo, xy.lo );
+            zx = blend4( zx, add4( add4( x2, y2 ), cx ), active );
+            zy = blend4( zy, add4( xy, cy ), active );
+
+            /* Active lanes hold all ones, so subtracting the mask counts them. */
+            iterations = _mm256_sub_epi64( iterations, _mm256_castpd_si256( active ) );
+
+            lanesteps += SIMD_LANES;
+            activesteps += __builtin_popcount( mask );
+
+            if ( periodic )
+            {
+                __m256d nearx = _mm256_cmp_pd( distance4( zx, savedx, sign ), tol, _CMP_LT_OQ );
+                __m256d neary = _mm256_cmp_pd( distance4( zy, savedy, sign ), tol, _CMP_LT_OQ );
+                __m256d cycle = _mm256_and_pd( active, _mm256_and_pd( nearx, neary ) );
+                int cyclemask = _mm256_movemask_pd( cycle );
+                if ( cyclemask )
+                {
+                    iterations = _mm256_castpd_si256( _mm256_blendv_pd( _mm256_castsi256_pd( iterations ),
+                                                                        _mm256_castsi256_pd( limit ), cycle ) );
+                    cycles += __builtin_popcount( cyclemask );
+                    if ( out->cycled )
+                    {
+                        for ( lane = 0; lane < SIMD_LANES; lane++ )
+                        {
+                            if ( cyclemask & (1 << lane) )
+                            {
+                                out->cycled[batch->index[slot[lane]]] = 1;
+                            }
+                        }
+                    }
+                }
+
+                __m256d save = _mm256_and_pd( active, _mm256_castsi256_pd( _mm256_cmpeq_epi64( iterations, nextsave ) ) );
+                if ( _mm256_movemask_pd( save ) )
+                {
+                    __m256i saveint = _mm256_castpd_si256( save );
+                    savedx = blend4( savedx, zx, save );
+                    savedy = blend4( savedy, zy, save );
+                    window = _mm256_blendv_epi8( window, _mm256_add_epi64( window, window ), saveint );
+                    nextsave = _mm256_blendv_epi8( nextsave, _mm256_add_epi64( iterations, window ), saveint );
+                }
+            }
+
+            __m256d mag2 = _mm256_add_pd( _mm256_mul_pd( zx.hi, zx.hi ), _mm256_mul_pd( zy.hi, zy.hi ) );
+            active = _mm256_and_pd( active, _mm256_cmp_pd( mag2, four, _CMP_LT_OQ ) );
+            active = _mm256_and_pd( active, _mm256_castsi256_pd( _mm256_cmpgt_epi64( limit, iterations ) ) );
+            mask = _mm256_movemask_pd( active );
+        }
+
+        store4( &lzx, zx );
+        store4( &lzy, zy );
+        store4( &lsavedx, savedx );
+        store4( &lsavedy, savedy );
+        _mm256_storeu_si256( (__m256i*)lit, iterations );
+        _mm256_storeu_si256( (__m256i*)lwindow, window );
+        _mm256_storeu_si256( (__m256i*)lnextsave, nextsave );
+    }
+
+    stats->lanesteps += lanesteps;
+    stats->activesteps += activesteps;
+    stats->cycles += cycles;
+}
+
+#endif
+
+void DD_RunBatch( const DD_Base* base, SIMD_Batch* batch, uint16_t max, double tolerance,
+                  SIMD_BatchOutput* out, SIMD_BatchStats* stats )
+{
+#if SIMD_AVX2_BUILT
+    if ( SIMD_HasAVX2( ) && hasFMA( ) )
+    {
+        runBatchAVX2( base, batch, max, tolerance, out, stats );
+        batch->count = 0;
+        return;
+    }
+#endif
+
+    runBatchScalar( base, batch, max, tolerance, out, stats );
+    batch->count = 0;
+}
@@ -6,9 +6,12 @@
 */
 
 #include "stdio.h"
+#include "string.h"
 #include "SDL.h"
 #include "Font.h"
 #include "fractals.h"
+#include "palette.h"
+#include "plotter.h"
 
 #define SCREEN_WIDTH 800
 #define SCREEN_HEIGHT 800
@@ -24,36 +27,57 @@
 #define IM_MIN_JULIA ((-1.5))
 #define IM_MAX_JULIA ((1.5))
 
-#define ZOOM_RATIO 0.5
-
 #define OVERLAY_SIZE 20
 
+// Replots show passes at 1/2^PREVIEW_SHIFT of the resolution and up first.
+#define PREVIEW_SHIFT 2
+
+// Each notch of the mouse wheel zooms by 2^WHEEL_STEP.
+#define WHEEL_STEP 0.25
+
+// Real-time zooming doubles or halves the scale this many times a second.
+#define REALTIME_RATE 1.0
+
 static inline int WithinRect( int x, int y, SDL_Rect rect );
-void ChangeMode( int mousex, int mousey, int* current_mode, double complex* c,
-                 double* remin, double* remax, double* immin, double* immax );
+void ChangeMode( int mousex, int mousey, int* current_mode, FractalPoint* c,
+                 FractalView* view );
 
-void Scale( double* remin, double* remax, double* immin, double* immax );
+void ResetView( int current_mode, FractalView* view );
 
-SDL_PixelFormat* texfmt;
+void Scale( FractalView* view );
 
-double logmax;
-double dc;
+int ReprojectRect( const FractalView* from, const FractalView* to, SDL_Rect* rect );
 
-void LogPlotter( uint16_t iterations, void* copyloc )
-{
-    Uint32* pix = copyloc;
-    double logit = log( iterations );
-    *pix = SDL_MapRGB( texfmt, 0, 0, logit * dc );
-}
+void PrintRenderStats( const PLT_Pass* pass, int saved );
 
-void Plotter( uint16_t iterations, void* copyloc )
-{
-    Uint32* pix = copyloc;
-    *pix = SDL_MapRGB( texfmt, 0, 0, iterations );
-}
+SDL_Texture* CreateFractalTexture( SDL_Renderer* winrend, Uint32 winfmt );
+SDL_Texture* CreatePreviewTexture( SDL_Renderer* winrend );
+
+Uint32 texfmt;
 
 int main( int argc, char** argv )
 {
+    // Read command line options.
+    // Tiles are only kept in a file when one is given.
+    const char* cachefile = NULL;
+    int arg;
+    for ( arg = 1; arg < argc; arg++ )
+    {
+        if ( strcmp( argv[arg], "-threads" ) == 0 && arg + 1 < argc )
+        {
+            SetRenderThreads( atoi( argv[++arg] ) );
+        }
+        else if ( strcmp( argv[arg], "-cache" ) == 0 && arg + 1 < argc )
+        {
+            cachefile = argv[++arg];
+        }
+    }
+
+    if ( cachefile && !SetTileCacheFile( cachefile ) )
+    {
+        printf( "Failed to open the tile cache file %s.\n", cachefile );
+    }
+
     // Initialize SDL 2.0.
     if ( SDL_Init( SDL_INIT_EVERYTHING ) < 0 )
     {
@@ -74,28 +98,40 @@ int main( int argc, char** argv )
     FNT_Font* font = FNT_InitFont( winrend, "rsc/540x20Font.bmp", "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789",
                                    2, 2, (SDL_Color){0, 40, 70} );
 
-    SDL_Texture* fractex = SDL_CreateTexture( winrend, SDL_GetWindowPixelFormat(window),
-                           SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH, SCREEN_HEIGHT );
-
-    Uint32 enumfmt;
-    SDL_QueryTexture( fractex, &enumfmt, NULL, NULL, NULL );
-    texfmt = SDL_AllocFormat( enumfmt );
+    Uint32 winfmt = SDL_GetWindowPixelFormat( window );
+    SDL_Texture* fractex = CreateFractalTexture( winrend, winfmt );
+    SDL_Texture* previewtex = fractex ? CreatePreviewTexture( winrend ) : NULL;
+    if ( !fractex || !previewtex )
+    {
+        printf( "Failed to create the fractal texture.\n" );
+        return 1;
+    }
 
-    Uint32* pixels;
-    int pitch;
-    uint16_t maxiter = 255;
-    logmax = log( maxiter );
-    dc = 255 / logmax;
+    // Plots render on their own thread, so input is never stuck behind one.
+    PLT_Plotter* plotter = PLT_CreatePlotter( SCREEN_WIDTH, SCREEN_HEIGHT, PREVIEW_SHIFT );
+    if ( !plotter )
+    {
+        printf( "Failed to start the plotter.\n" );
+        return 1;
+    }
 
-    SDL_LockTexture( fractex, NULL, (void**)&pixels, &pitch );
-    PlotMandelbrotF( pixels, 4, pitch, SCREEN_WIDTH, SCREEN_HEIGHT,
-                     RE_MIN_MANDELBROT + IM_MIN_MANDELBROT * I,
-                     RE_MAX_MANDELBROT + IM_MAX_MANDELBROT * I, &maxiter, Plotter );
-    SDL_UnlockTexture( fractex );
+    // What is on screen: the whole fractal texture, or a coarse pass scaled up,
+    // and the request it was plotted for. Nothing until the first pass is done.
+    SDL_Texture* shown = fractex;
+    SDL_Rect shownsrc = { 0, 0, 0, 0 };
+    SDL_Rect showndst = shownsrc;
+    PLT_Request request = { 0 };
+    PLT_Request shownrequest = { 0 };
 
-    SDL_RenderCopy( winrend, fractex, NULL, NULL );
+    uint16_t maxiter = 255;
+    int palette_mode = PAL_LINEAR;
+    int strategy = GetRenderStrategy( );
+    int periodicity = GetPeriodicityCheck( );
+    int approximation = GetDeepApproximation( );
 
-    SDL_RenderPresent( winrend );
+    FractalView view;
+    SetView( &view, RE_MIN_MANDELBROT + IM_MIN_MANDELBROT * I,
+             RE_MAX_MANDELBROT + IM_MAX_MANDELBROT * I, SCREEN_WIDTH, SCREEN_HEIGHT );
 
 #define MODE_MANDELBROT 0
 #define MODE_JULIA 1
@@ -106,26 +142,99 @@ int main( int argc, char** argv )
     int current_mode = MODE_MANDELBROT;
     int current_action = ACTION_ZOOM;
 
-    double remin = RE_MIN_MANDELBROT;
-    double remax = RE_MAX_MANDELBROT;
-    double immin = IM_MIN_MANDELBROT;
-    double immax = IM_MAX_MANDELBROT;
-
+    // Changes since the last plot that need a new one or new colors.
     int replot = 1;
+    int recolor = 0;
+    int saved = 0;
+    int redraw = 0;
     int overlay_active = 0;
     int show_overlay = 0;
     int clear_overlay = 0;
+    int dragging = 0;
+    int dragged = 0;
+    int realtime = 0;
+    int zooming = 0;
+    Uint64 zoomtick = 0;
 
-    double complex c = 0;
+    // The last full pass rendered, printed on request.
+    PLT_Pass lastpass;
+    int havepass = 0;
 
-    PlotFunction plotter = Plotter;
+    // The Julia set's c, to the precision of the view it was picked from.
+    FractalPoint c;
+    SetPoint( &c, 0 );
 
     // Wait for the user to quit.
     SDL_Event event;
     do
     {
+        // Plot once the queue is drained, so a burst of input is folded into
+        // the view and only its final state is plotted.
+        if ( (replot || recolor) && !SDL_PollEvent( NULL ) )
+        {
+            saved += replot + recolor - 1;
+
+            // Replaces the plot in progress, if any.
+            request.julia = current_mode == MODE_JULIA;
+            request.c = c;
+            request.view = view;
+            request.maxiter = maxiter;
+            request.palette_mode = palette_mode;
+            request.format = texfmt;
+            request.strategy = strategy;
+            request.periodicity = periodicity;
+            request.approximation = approximation;
+            request.progressive = replot && !dragging && !zooming;
+            request.realtime = zooming != 0;
+            request.recolor = !replot;
+            PLT_Submit( plotter, &request );
+
+            replot = 0;
+            recolor = 0;
+        }
+
         SDL_WaitEvent( &event );
-        if ( event.type == SDL_MOUSEBUTTONDOWN )
+        if ( event.type == PLT_GetEventType( ) )
+        {
+            // A pass of the plot is done; coarse passes are scaled up to the window.
+            PLT_Pass pass;
+            if ( PLT_LockPass( plotter, &pass ) )
+            {
+                shown = pass.shift ? previewtex : fractex;
+                shownsrc.x = 0;
+                shownsrc.y = 0;
+                shownsrc.w = pass.w;
+                shownsrc.h = pass.h;
+                showndst.x = -pass.offx;
+                showndst.y = -pass.offy;
+                showndst.w = pass.w << pass.shift;
+                showndst.h = pass.h << pass.shift;
+                SDL_UpdateTexture( shown, &shownsrc, pass.pixels, pass.pitch );
+                PLT_UnlockPass( plotter );
+                shownrequest = request;
+                redraw = 1;
+
+                // Zoom on from the frame just shown, by the time it took.
+                if ( zooming )
+                {
+                    Uint64 now = SDL_GetPerformanceCounter( );
+                    double seconds = (double)(now - zoomtick) / SDL_GetPerformanceFrequency( );
+                    zoomtick = now;
+
+                    int mousex, mousey;
+                    SDL_GetMouseState( &mousex, &mousey );
+                    ScaleView( &view, exp2( zooming * seconds * REALTIME_RATE ), mousex, mousey );
+                    replot++;
+                }
+
+                if ( !pass.shift && !pass.recolor && !request.realtime )
+                {
+                    lastpass = pass;
+                    havepass = 1;
+                }
+            }
+        }
+        else if ( event.type == SDL_MOUSEBUTTONDOWN )
         {
             if ( overlay_active )
             {
@@ -166,33 +275,20 @@ int main( int argc, char** argv )
                 }
                 else if ( WithinRect( x, y, O ) )
                 {
-                    if ( current_mode == MODE_JULIA )
-                    {
-                        remin = RE_MIN_JULIA;
-                        remax = RE_MAX_JULIA;
-                        immin = IM_MIN_JULIA;
-                        immax = IM_MAX_JULIA;
-                    }
-                    else
-                    {
-                        remin = RE_MIN_MANDELBROT;
-                        remax = RE_MAX_MANDELBROT;
-                        immin = IM_MIN_MANDELBROT;
-                        immax = IM_MAX_MANDELBROT;
-                    }
-                    replot = 1;
+                    ResetView( current_mode, &view );
+                    replot++;
                 }
                 else if ( WithinRect( x, y, L ) )
                 {
-                    if ( plotter == LogPlotter )
+                    if ( palette_mode == PAL_LOG )
                     {
-                        plotter = Plotter;
+                        palette_mode = PAL_LINEAR;
                     }
                     else
                     {
-                        plotter = LogPlotter;
+                        palette_mode = PAL_LOG;
                     }
-                    replot = 1;
+                    recolor++;
                 }
 
                 clear_overlay = 1;
@@ -201,84 +297,183 @@ int main( int argc, char** argv )
             {
                 show_overlay = 1;
             }
-            else if ( current_action == ACTION_FRACTAL )
+            else if ( realtime )
+            {
+                // Zoom in with the left button or out with the right until released.
+                zooming = event.button.button == SDL_BUTTON_RIGHT ? -1 : 1;
+                zoomtick = SDL_GetPerformanceCounter( );
+                replot++;
+            }
+            else
+            {
+                // Wait for the release to tell a click from a drag.
+                dragging = 1;
+                dragged = 0;
+            }
+        }
+        else if ( event.type == SDL_MOUSEMOTION )
+        {
+            if ( dragging && (event.motion.xrel || event.motion.yrel) )
+            {
+                // Pan by whole pixels, so only the exposed strips are computed.
+                view.x -= event.motion.xrel;
+                view.y -= event.motion.yrel;
+                dragged = 1;
+                replot++;
+            }
+        }
+        else if ( event.type == SDL_MOUSEWHEEL )
+        {
+            if ( event.wheel.y )
+            {
+                int mousex, mousey;
+                SDL_GetMouseState( &mousex, &mousey );
+                ScaleView( &view, exp2( event.wheel.y * WHEEL_STEP ), mousex, mousey );
+                replot++;
+            }
+        }
+        else if ( event.type == SDL_MOUSEBUTTONUP )
+        {
+            if ( zooming )
             {
-                ChangeMode( event.button.x, event.button.y, &current_mode,
-                    &c, &remin, &remax, &immin, &immax );
-                replot = 1;
+                // Refine the approximate frames once the zoom stops.
+                zooming = 0;
+                replot++;
             }
-            else if ( current_action == ACTION_ZOOM )
+            else if ( dragging && !dragged )
             {
-                Scale( &remin, &remax, &immin, &immax );
-                replot = 1;
+                if ( current_action == ACTION_FRACTAL )
+                {
+                    ChangeMode( event.button.x, event.button.y, &current_mode, &c, &view );
+                    replot++;
+                }
+                else if ( current_action == ACTION_ZOOM )
+                {
+                    Scale( &view );
+                    replot++;
+                }
             }
+            dragging = 0;
         }
         else if ( event.type == SDL_KEYDOWN )
         {
             if ( event.key.keysym.sym == SDLK_z )
             {
-                Scale( &remin, &remax, &immin, &immax );
-                replot = 1;
+                Scale( &view );
+                replot++;
+            }
+            else if ( event.key.keysym.sym == SDLK_x )
+            {
+                realtime = !realtime;
             }
             else if ( event.key.keysym.sym == SDLK_o )
             {
-                if ( current_mode == MODE_JULIA )
-                {
-                    remin = RE_MIN_JULIA;
-                    remax = RE_MAX_JULIA;
-                    immin = IM_MIN_JULIA;
-                    immax = IM_MAX_JULIA;
-                }
-                else
+                ResetView( current_mode, &view );
+                replot++;
+            }
+            else if ( event.key.keysym.sym == SDLK_i )
+            {
+                // Pixels that had not escaped carry on from where they stopped.
+                maxiter = maxiter > UINT16_MAX / 2 ? UINT16_MAX : maxiter * 2;
+                replot++;
+            }
+            else if ( event.key.keysym.sym == SDLK_p )
+            {
+                periodicity = !periodicity;
+                replot++;
+            }
+            else if ( event.key.keysym.sym == SDLK_s )
+            {
+                strategy = (strategy + 1) % RENDER_STRATEGIES;
+                replot++;
+            }
+            else if ( event.key.keysym.sym == SDLK_b )
+            {
+                approximation = (approximation + 1) % APPROX_MODES;
+                replot++;
+            }
+            else if ( event.key.keysym.sym == SDLK_t )
+            {
+                if ( havepass )
                 {
-                    remin = RE_MIN_MANDELBROT;
-                    remax = RE_MAX_MANDELBROT;
-                    immin = IM_MIN_MANDELBROT;
-                    immax = IM_MAX_MANDELBROT;
+                    PrintRenderStats( &lastpass, saved );
                 }
-                replot = 1;
             }
             else if ( event.key.keysym.sym == SDLK_l )
             {
-                if ( plotter == LogPlotter )
+                if ( palette_mode == PAL_LOG )
                 {
-                    plotter = Plotter;
+                    palette_mode = PAL_LINEAR;
                 }
                 else
                 {
-                    plotter = LogPlotter;
+                    palette_mode = PAL_LOG;
                 }
-                replot = 1;
+                recolor++;
             }
         }
 
-        if ( replot || show_overlay || clear_overlay )
+        else if ( event.type == SDL_WINDOWEVENT )
         {
-            if (replot)
+            // The window may have moved to a display with another pixel format.
+            if ( SDL_GetWindowPixelFormat( window ) != winfmt )
             {
-                SDL_LockTexture( fractex, NULL, (void**)&pixels, &pitch );
-                if ( current_mode == MODE_JULIA )
+                winfmt = SDL_GetWindowPixelFormat( window );
+                SDL_DestroyTexture( fractex );
+                SDL_DestroyTexture( previewtex );
+                fractex = CreateFractalTexture( winrend, winfmt );
+                previewtex = fractex ? CreatePreviewTexture( winrend ) : NULL;
+                if ( !fractex || !previewtex )
                 {
-                    PlotJuliaF( c, pixels, 4, pitch, SCREEN_WIDTH, SCREEN_HEIGHT,
-                                remin + immin * I, remax + immax * I, &maxiter, plotter );
+                    printf( "Failed to create the fractal texture.\n" );
+                    break;
                 }
-                else
+
+                // Nothing is shown until the recolored frame comes back.
+                shown = fractex;
+                shownsrc.w = 0;
+                shownsrc.h = 0;
+                recolor++;
+            }
+        }
+
+        if ( (redraw || replot || show_overlay || clear_overlay) && !SDL_PollEvent( NULL ) )
+        {
+            // Until the plot of a new view comes back, the last one is moved and
+            // scaled to where it lies in the new view.
+            SDL_SetRenderDrawColor( winrend, 0, 0, 0, SDL_ALPHA_OPAQUE );
+            SDL_RenderClear( winrend );
+
+            SDL_Rect dst = showndst;
+            int julia = current_mode == MODE_JULIA;
+            if ( shownrequest.julia == julia && (!julia || SamePoint( &shownrequest.c, &c )) )
+            {
+                if ( ReprojectRect( &shownrequest.view, &view, &dst ) )
                 {
-                    PlotMandelbrotF( pixels, 4, pitch, SCREEN_WIDTH, SCREEN_HEIGHT,
-                                     remin + immin * I, remax + immax * I, &maxiter, plotter );
+                    SDL_RenderCopy( winrend, shown, &shownsrc, &dst );
                 }
-                SDL_UnlockTexture( fractex );
-                SDL_RenderCopy( winrend, fractex, NULL, NULL );
-                replot = 0;
             }
+            else
+            {
+                SDL_RenderCopy( winrend, shown, &shownsrc, &dst );
+            }
+            redraw = 0;
 
             if ( show_overlay )
             {
                 overlay_active = 1;
                 show_overlay = 0;
+            }
+
+            if ( clear_overlay )
+            {
+                overlay_active = 0;
+                clear_overlay = 0;
+            }
 
-                SDL_RenderCopy( winrend, fractex, NULL, NULL );
-                
+            // Passes arriving while the overlay is up are drawn under it.
+            if ( overlay_active )
+            {
                 SDL_Rect overlay_rect;
                 overlay_rect.x = 0;
                 overlay_rect.y = 0;
@@ -291,21 +486,15 @@ int main( int argc, char** argv )
                 FNT_DrawText( winrend, font, "F  Z  O  L", 0, 0, OVERLAY_SIZE, FNT_ALIGNLEFT | FNT_ALIGNTOP );
             }
 
-            if ( clear_overlay )
-            {
-                overlay_active = 0;
-                clear_overlay = 0;
-
-                SDL_RenderCopy( winrend, fractex, NULL, NULL );
-            }
-
             SDL_RenderPresent( winrend );
         }
     } while ( event.type != SDL_QUIT );
 
     FNT_DestroyFont( font );
+    PLT_DestroyPlotter( plotter );
+    ShutdownRender( );
 
-    SDL_FreeFormat( texfmt );
+    SDL_DestroyTexture( previewtex );
     SDL_DestroyTexture( fractex );
 
     // Destroy the window and rendering context.
@@ -319,6 +508,29 @@ int main( int argc, char** argv )
     return 0;
 }
 
+SDL_Texture* CreateFractalTexture( SDL_Renderer* winrend, Uint32 winfmt )
+{
+    SDL_Texture* fractex = SDL_CreateTexture( winrend, winfmt, SDL_TEXTUREACCESS_STREAMING,
+                                              SCREEN_WIDTH, SCREEN_HEIGHT );
+    if ( !fractex )
+    {
+        return NULL;
+    }
+
+    // The renderer may pick a different format than the one asked for.
+    SDL_QueryTexture( fractex, &texfmt, NULL, NULL, NULL );
+
+    return fractex;
+}
+
+/* A texture for the coarse passes of a replot, in the fractal texture's
+   format. The largest coarse pass is half the window plus a pixel. */
+SDL_Texture* CreatePreviewTexture( SDL_Renderer* winrend )
+{
+    return SDL_CreateTexture( winrend, texfmt, SDL_TEXTUREACCESS_STREAMING,
+                              SCREEN_WIDTH / 2 + 1, SCREEN_HEIGHT / 2 + 1 );
+}
+
 int WithinRect( int x, int y, SDL_Rect rect )
 {
     if ( x >= rect.x && x <= rect.x + rect.w
@@ -329,47 +541,125 @@ int WithinRect( int x, int y, SDL_Rect rect )
     else return 0;
 }
 
-void ChangeMode( int mousex, int mousey, int* current_mode, double complex* c,
-                 double* remin, double* remax, double* immin, double* immax )
+void ChangeMode( int mousex, int mousey, int* current_mode, FractalPoint* c,
+                 FractalView* view )
 {
     if ( *current_mode == MODE_MANDELBROT )
     {
         *current_mode = MODE_JULIA;
+        ViewPrecisePoint( view, mousex, mousey, c );
+    }
+    else
+    {
+        *current_mode = MODE_MANDELBROT;
+    }
 
-        double scalex = (*remax - *remin) / SCREEN_WIDTH;
-        double scaley = (*immax - *immin) / SCREEN_HEIGHT;
-        double adjustx = mousex * scalex + *remin;
-        double adjusty = mousey * scaley + *immin;
-        *c = adjustx + adjusty * I;
+    ResetView( *current_mode, view );
+}
 
-        *remin = RE_MIN_JULIA;
-        *remax = RE_MAX_JULIA;
-        *immin = IM_MIN_JULIA;
-        *immax = IM_MAX_JULIA;
+void ResetView( int current_mode, FractalView* view )
+{
+    if ( current_mode == MODE_JULIA )
+    {
+        SetView( view, RE_MIN_JULIA + IM_MIN_JULIA * I, RE_MAX_JULIA + IM_MAX_JULIA * I,
+                 SCREEN_WIDTH, SCREEN_HEIGHT );
     }
     else
     {
-        *current_mode = MODE_MANDELBROT;
+        SetView( view, RE_MIN_MANDELBROT + IM_MIN_MANDELBROT * I,
+                 RE_MAX_MANDELBROT + IM_MAX_MANDELBROT * I, SCREEN_WIDTH, SCREEN_HEIGHT );
+    }
+}
 
-        *remin = RE_MIN_MANDELBROT;
-        *remax = RE_MAX_MANDELBROT;
-        *immin = IM_MIN_MANDELBROT;
-        *immax = IM_MAX_MANDELBROT;
+/* Moves rect, in pixels of view from, to where the same part of the plane
+   lies in pixels of view to. Returns 0 if it ends up too far out to draw. */
+int ReprojectRect( const FractalView* from, const FractalView* to, SDL_Rect* rect )
+{
+    double fromre = ldexp( from->dre, -from->level );
+    double fromim = ldexp( from->dim, -from->level );
+    double tore = ldexp( to->dre, -to->level );
+    double toim = ldexp( to->dim, -to->level );
+
+    complex double offset = ViewOffset( from, to );
+    double x0 = creal( offset ) / tore + rect->x * (fromre / tore);
+    double y0 = cimag( offset ) / toim + rect->y * (fromim / toim);
+    double x1 = x0 + rect->w * (fromre / tore);
+    double y1 = y0 + rect->h * (fromim / toim);
+
+    double limit = 64.0 * (SCREEN_WIDTH + SCREEN_HEIGHT);
+    if ( !(fabs( x0 ) < limit && fabs( y0 ) < limit && fabs( x1 ) < limit && fabs( y1 ) < limit) )
+    {
+        return 0;
     }
+
+    rect->x = (int)floor( x0 + 0.5 );
+    rect->y = (int)floor( y0 + 0.5 );
+    rect->w = (int)floor( x1 + 0.5 ) - rect->x;
+    rect->h = (int)floor( y1 + 0.5 ) - rect->y;
+    return 1;
 }
 
-void Scale( double* remin, double* remax, double* immin, double* immax )
+/* Zooms in 2x around the mouse. The view stays on its pixel grid, so a
+   quarter of the zoomed view's pixels are carried over from the last plot. */
+void Scale( FractalView* view )
 {
     int mousex, mousey;
     SDL_GetMouseState( &mousex, &mousey );
 
-    double scalex = (*remax - *remin) / SCREEN_WIDTH;
-    double scaley = (*immax - *immin) / SCREEN_HEIGHT;
-    double adjustx = mousex * scalex + *remin;
-    double adjusty = mousey * scaley + *immin;
+    ZoomView( view, mousex, mousey );
+}
+
+void PrintRenderStats( const PLT_Pass* pass, int saved )
+{
+    RenderStats stats = pass->stats;
+
+    double busy = 0;
+    if ( stats.lanesteps )
+    {
+        busy = 100.0 * stats.activesteps / stats.lanesteps;
+    }
+
+    const char* strategies[RENDER_STRATEGIES] = { "brute force", "subdivision", "boundary tracing" };
+    double iterated = 0;
+    double reused = 0;
+    if ( stats.pixels )
+    {
+        iterated = 100.0 * stats.iterated / stats.pixels;
+        reused = 100.0 * stats.reused / stats.pixels;
+    }
 
-    *remin = *remin + (adjustx - *remin) * ZOOM_RATIO;
-    *remax = *remax - (*remax - adjustx) * ZOOM_RATIO;
-    *immin = *immin + (adjusty - *immin) * ZOOM_RATIO;
-    *immax = *immax - (*immax - adjusty) * ZOOM_RATIO;
+    printf( "Rendered %llu pixels by %s on %d threads, %.1f%% iterated, %.1f%% reused, lanes busy %.1f%%.\n",
+            (unsigned long long)stats.pixels, strategies[stats.strategy], stats.threads,
+            iterated, reused, busy );
+    printf( "Resumed %llu pixels stopped by a lower maxiter.\n",
+            (unsigned long long)stats.resumed );
+    printf( "Cardioid test skipped %llu pixels, periodicity check stopped %llu early.\n",
+            (unsigned long long)stats.cardioidskips, (unsigned long long)stats.cycleskips );
+    printf( "Took %llu of %llu tiles from the tile cache, %llu of them from its file.\n",
+            (unsigned long long)stats.cachedtiles, (unsigned long long)stats.tiles,
+            (unsigned long long)stats.filetiles );
+    if ( stats.doubledouble )
+    {
+        printf( "Iterated in double-double arithmetic, to about 106 bits.\n" );
+    }
+    if ( stats.referencebits )
+    {
+        printf( "Perturbed off a reference orbit of %d iterations held to %d bits.\n",
+                stats.referencelength, stats.referencebits );
+        printf( "Used %d reference orbits, iterating %llu glitched pixels again.\n",
+                stats.references, (unsigned long long)stats.reiterated );
+        if ( stats.approximation == APPROX_BLA )
+        {
+            printf( "Bilinear approximation skipped %llu iterations, saving about %.1f ms, and rebased %llu times.\n",
+                    (unsigned long long)stats.skippedsteps, stats.savedms,
+                    (unsigned long long)stats.rebases );
+        }
+        else
+        {
+            printf( "Series approximation skipped %d iterations a pixel, %llu in all, saving about %.1f ms.\n",
+                    stats.seriesskip, (unsigned long long)stats.skippedsteps, stats.savedms );
+        }
+    }
+    printf( "First pass ready after %.1f ms, full frame after %.1f ms.\n", pass->firstms, pass->passms );
+    printf( "Folding input into fewer plots has saved %d so far.\n", saved );
 }
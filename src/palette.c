@@ -0,0 +1,125 @@
+/*
+
+    Implementation file for precomputed color palettes.
+    Mapping an escape count to a color takes a logarithm and SDL_MapRGB,
+    which cost as much as iterating in quickly escaping regions. A palette
+    does that once per escape count, so coloring a pixel is a lookup.
+
+*/
+
+#include "stdlib.h"
+#include "math.h"
+#include "palette.h"
+
+PAL_Palette* PAL_CreatePalette( void )
+{
+    PAL_Palette* pal = malloc( sizeof(PAL_Palette) );
+    if ( !pal )
+    {
+        return NULL;
+    }
+
+    pal->lut = NULL;
+    pal->mode = -1;
+    pal->format = SDL_PIXELFORMAT_UNKNOWN;
+    pal->maxiter = 0;
+    return pal;
+}
+
+/* Rebuilds the lookup table if the pixel format, maxiter or mode differ
+   from the ones it was built for. Returns 0 if it could not be built. */
+int PAL_UpdatePalette( PAL_Palette* pal, SDL_PixelFormat* fmt, Uint16 maxiter, int mode )
+{
+    if ( pal->lut && pal->format == fmt->format && pal->maxiter == maxiter && pal->mode == mode )
+    {
+        return 1;
+    }
+
+    Uint32* lut = realloc( pal->lut, ((size_t)maxiter + 1) * sizeof(Uint32) );
+    if ( !lut )
+    {
+        return 0;
+    }
+    pal->lut = lut;
+
+    /* The same shades of blue the per-pixel colorizers produced: the low
+       byte of the count, or its logarithm scaled so maxiter is brightest. */
+    double dc = 255 / log( maxiter );
+
+    int i;
+    for ( i = 0; i <= maxiter; i++ )
+    {
+        Uint8 blue = (Uint8)i;
+        if ( mode == PAL_LOG )
+        {
+            blue = i > 1 ? (Uint8)(log( i ) * dc) : 0;
+        }
+        lut[i] = SDL_MapRGB( fmt, 0, 0, blue );
+    }
+
+    pal->format = fmt->format;
+    pal->maxiter = maxiter;
+    pal->mode = mode;
+    return 1;
+}
+
+void PAL_DestroyPalette( PAL_Palette* pal )
+{
+    if ( pal )
+    {
+        free( pal->lut );
+        free( pal );
+    }
+}
+
+/* Mixes two packed colors a byte at a time, t of the way from a to b. */
+static inline Uint32 mixColors( Uint32 a, Uint32 b, float t )
+{
+    Uint32 mixed = 0;
+    int shift;
+    for ( shift = 0; shift < 32; shift += 8 )
+    {
+        int ca = (a >> shift) & 0xFF;
+        int cb = (b >> shift) & 0xFF;
+        mixed |= (Uint32)(ca + (int)((cb - ca) * t)) << shift;
+    }
+    return mixed;
+}
+
+void PAL_ColorSpan( const uint16_t* iterations, const float* smooth, int count,
+                    void* dst, void* userdata )
+{
+    const PAL_Palette* pal = userdata;
+    const Uint32* lut = pal->lut;
+    Uint32* pix = dst;
+    int n;
+    if ( !smooth )
+    {
+        for ( n = 0; n < count; n++ )
+        {
+            pix[n] = lut[iterations[n]];
+        }
+        return;
+    }
+
+    for ( n = 0; n < count; n++ )
+    {
+        if ( iterations[n] >= pal->maxiter )
+        {
+            pix[n] = lut[iterations[n]];
+            continue;
+        }
+
+        float s = smooth[n];
+        if ( !(s > 0) )
+        {
+            s = 0;
+        }
+        if ( s > pal->maxiter - 1 )
+        {
+            s = pal->maxiter - 1;
+        }
+        int i = (int)s;
+        pix[n] = mixColors( lut[i], lut[i + 1], s - i );
+    }
+}
@@ -0,0 +1,767 @@
+/*
+
+    Implementation file for perturbation rendering at deep zoom.
+    Past the precision of a double, neighbouring pixels can no longer be
+    told apart, but their orbits can still be followed as small offsets
+    from the orbit of a nearby reference point. Writing a pixel's orbit as
+    z = Z + d, with Z the reference orbit, z^2 + c becomes
+
+        d' = 2 Z d + d^2 + dc
+
+    where dc is the pixel's offset in c. The offsets stay small, so doubles
+    hold them to full relative precision however deep the zoom; only the
+    reference orbit needs the high-precision numbers, and only once.
+
+    Where a pixel's z comes much closer to 0 than the reference orbit's,
+    its offset is no longer small next to z, the doubles lose the detail
+    that sets it apart from its neighbours, and it comes out wrong. Such
+    glitches are caught with Pauldelbrot's criterion, |z| < |Z| * 10^-3,
+    and the pixel is given a count of 0, to be iterated again off another
+    reference. A pixel that outlives an escaped reference orbit carries on
+    with its own z in plain doubles, which is all that is left of it by
+    then: past the orbit's escape, z is no longer small next to it. It
+    has lost the view's precision, though, and may come out wrong.
+
+    For the early iterations, while the offsets still grow close to
+    linearly, d is all but a polynomial in the pixel's offset u: truncated
+    to a u + b u^2 + c u^3, the coefficients follow the reference orbit as
+
+        a' = 2 Z a + 1,  b' = 2 Z b + a^2,  c' = 2 Z c + 2 a b
+
+    for the Mandelbrot set, and the same without the 1 for a Julia set,
+    whose a starts at 1. One run of that replaces the same iterations of
+    every pixel in the view. How far it can go is found by iterating a few
+    probe pixels at the edge of the view exactly alongside, and stopping
+    once the series strays from any of them by a fraction of the distance
+    between the closest neighbouring pixels among them. u is scaled by the
+    distance to the furthest probe, so the coefficients stay near the size
+    of the offsets instead of overflowing; the offsets themselves are too
+    small to square at the deepest zooms, so their sizes are taken with
+    hypot.
+
+    Bilinear approximation, after Zhuoran, does the same for each pixel
+    separately. While |d| is tiny next to |Z|, one step is d' = A d + B dc,
+    with A = 2 Z and B = 1, or 0 for a Julia set, and two such maps compose
+    into another. A table holds the maps over 1, 2, 4, ... iterations along
+    the orbit, each with the radius within which d^2 stays below epsilon
+    times A d at every step it covers, and a pixel takes the longest map its
+    offset allows. Mandelbrot pixels are rebased instead of glitching: once
+    z is closer to 0 than to Z, or the orbit runs out, d becomes z and the
+    pixel carries on from the start of the orbit, where Z is 0.
+
+    Like the batch engine, the kernel runs SIMD_LANES pixels at once with
+    AVX2 where it is available, and matches the scalar kernel exactly.
+
+*/
+
+#include "stdlib.h"
+#include "string.h"
+#include "math.h"
+#include "perturb.h"
+
+#if SIMD_AVX2_BUILT
+#include "immintrin.h"
+#endif
+
+PTB_Reference* PTB_CreateReference( void )
+{
+    return calloc( 1, sizeof(PTB_Reference) );
+}
+
+void PTB_DestroyReference( PTB_Reference* reference )
+{
+    if ( reference )
+    {
+        free( reference->zx );
+        free( reference->zy );
+        free( reference );
+    }
+}
+
+static int sameReference( const PTB_Reference* reference, int julia, const BIG_Number* re,
+                          const BIG_Number* im, const BIG_Number* cre, const BIG_Number* cim,
+                          int limbs )
+{
+    return reference->length > 0 && reference->julia == julia && reference->limbs >= limbs
+           && BIG_Equal( &reference->re, re ) && BIG_Equal( &reference->im, im )
+           && (!julia || (BIG_Equal( &reference->cre, cre ) && BIG_Equal( &reference->cim, cim )));
+}
+
+/* Appends z to the orbit, which ends once z escapes. */
+static void storePoint( PTB_Reference* reference, const BIG_Number* x, const BIG_Number* y )
+{
+    double zx = BIG_ToDouble( x );
+    double zy = BIG_ToDouble( y );
+    reference->zx[reference->length] = zx;
+    reference->zy[reference->length] = zy;
+    reference->length++;
+    if ( zx * zx + zy * zy >= 2 * 2 )
+    {
+        reference->escaped = 1;
+    }
+}
+
+int PTB_ComputeReference( PTB_Reference* reference, int julia, const BIG_Number* re,
+                          const BIG_Number* im, const BIG_Number* cre, const BIG_Number* cim,
+                          uint16_t maxiter, int limbs, PTB_CancelFunction cancelled,
+                          void* userdata )
+{
+    if ( !sameReference( reference, julia, re, im, cre, cim, limbs ) )
+    {
+        reference->julia = julia;
+        reference->re = *re;
+        reference->im = *im;
+        reference->cre = julia ? *cre : *re;
+        reference->cim = julia ? *cim : *im;
+        reference->cx = BIG_ToDouble( &reference->cre );
+        reference->cy = BIG_ToDouble( &reference->cim );
+        reference->limbs = limbs;
+        reference->maxiter = 0;
+        reference->escaped = 0;
+        reference->length = 0;
+    }
+
+    if ( maxiter > reference->maxiter )
+    {
+        double* zx = realloc( reference->zx, maxiter * sizeof(double) );
+        if ( zx )
+        {
+            reference->zx = zx;
+        }
+        double* zy = realloc( reference->zy, maxiter * sizeof(double) );
+        if ( zy )
+        {
+            reference->zy = zy;
+        }
+        if ( !zx || !zy )
+        {
+            reference->length = 0;
+            return 0;
+        }
+        reference->maxiter = maxiter;
+    }
+
+    BIG_Number x = reference->lastx;
+    BIG_Number y = reference->lasty;
+    if ( reference->length == 0 )
+    {
+        if ( julia )
+        {
+            x = *re;
+            y = *im;
+        }
+        else
+        {
+            BIG_Zero( &x );
+            BIG_Zero( &y );
+        }
+        storePoint( reference, &x, &y );
+    }
+
+    BIG_Number x2, y2, xy;
+
+    limbs = reference->limbs;
+    while ( !reference->escaped && reference->length < maxiter )
+    {
+        if ( cancelled && cancelled( userdata ) )
+        {
+            reference->lastx = x;
+            reference->lasty = y;
+            return 0;
+        }
+
+        BIG_Mul( &x2, &x, &x, limbs );
+        BIG_Mul( &y2, &y, &y, limbs );
+        BIG_Mul( &xy, &x, &y, limbs );
+        BIG_Sub( &x, &x2, &y2 );
+        BIG_Add( &x, &x, &reference->cre );
+        BIG_Add( &y, &xy, &xy );
+        BIG_Add( &y, &y, &reference->cim );
+        storePoint( reference, &x, &y );
+    }
+
+    reference->lastx = x;
+    reference->lasty = y;
+    return 1;
+}
+
+int PTB_ComputeSeries( PTB_Series* series, const PTB_Reference* reference, const double* probex,
+                       const double* probey, int probes, double pixelsize, uint16_t maxiter )
+{
+    int julia = reference->julia;
+    const double* refx = reference->zx;
+    const double* refy = reference->zy;
+    double dx[PTB_SERIES_PROBES], dy[PTB_SERIES_PROBES];
+    double ux[PTB_SERIES_PROBES], uy[PTB_SERIES_PROBES];
+    int p, k;
+
+    memset( series, 0, sizeof(PTB_Series) );
+    if ( probes > PTB_SERIES_PROBES )
+    {
+        probes = PTB_SERIES_PROBES;
+    }
+    for ( p = 0; p < probes; p++ )
+    {
+        double r = hypot( probex[p], probey[p] );
+        series->radius = r > series->radius ? r : series->radius;
+    }
+    if ( series->radius == 0 )
+    {
+        return 0;
+    }
+
+    double radius = series->radius;
+    for ( p = 0; p < probes; p++ )
+    {
+        ux[p] = probex[p] / radius;
+        uy[p] = probey[p] / radius;
+        dx[p] = julia ? probex[p] : 0;
+        dy[p] = julia ? probey[p] : 0;
+    }
+
+    /* The coefficients of u, u^2 and u^3 after k iterations. */
+    double ax = julia ? radius : 0;
+    double ay = 0;
+    double bx = 0, by = 0, cx = 0, cy = 0;
+
+    for ( k = 0; k + 1 < reference->length && k + 2 < maxiter; k++ )
+    {
+        double zx = refx[k];
+        double zy = refy[k];
+        double nax = 2 * (zx * ax - zy * ay) + (julia ? 0 : radius);
+        double nay = 2 * (zx * ay + zy * ax);
+        double nbx = 2 * (zx * bx - zy * by) + ax * ax - ay * ay;
+        double nby = 2 * (zx * by + zy * bx) + 2 * ax * ay;
+        double ncx = 2 * (zx * cx - zy * cy) + 2 * (ax * bx - ay * by);
+        double ncy = 2 * (zx * cy + zy * cx) + 2 * (ax * by + ay * bx);
+
+        double refmag2 = refx[k + 1] * refx[k + 1] + refy[k + 1] * refy[k + 1];
+        double furthest = 0;
+        double error = 0;
+        double spacing = HUGE_VAL;
+        int glitched = 0;
+
+        for ( p = 0; p < probes; p++ )
+        {
+            double tx = 2 * zx + dx[p];
+            double ty = 2 * zy + dy[p];
+            double xtemp = dx[p];
+            dx[p] = tx * dx[p] - ty * dy[p] + (julia ? 0 : probex[p]);
+            dy[p] = tx * dy[p] + ty * xtemp + (julia ? 0 : probey[p]);
+
+            /* Neighbouring pixels' offsets are apart by the series'
+               derivative times a pixel over radius. */
+            double gx = 3 * (ncx * ux[p] - ncy * uy[p]) + 2 * nbx;
+            double gy = 3 * (ncx * uy[p] + ncy * ux[p]) + 2 * nby;
+            xtemp = gx;
+            gx = gx * ux[p] - gy * uy[p] + nax;
+            gy = xtemp * uy[p] + gy * ux[p] + nay;
+            double apart = hypot( gx, gy ) * (pixelsize / radius);
+            spacing = apart < spacing ? apart : spacing;
+
+            /* The series at u, by Horner's rule. */
+            double sx = ncx * ux[p] - ncy * uy[p] + nbx;
+            double sy = ncx * uy[p] + ncy * ux[p] + nby;
+            xtemp = sx;
+            sx = sx * ux[p] - sy * uy[p] + nax;
+            sy = xtemp * uy[p] + sy * ux[p] + nay;
+            xtemp = sx;
+            sx = sx * ux[p] - sy * uy[p];
+            sy = xtemp * uy[p] + sy * ux[p];
+            double off = hypot( sx - dx[p], sy - dy[p] );
+            error = off > error ? off : error;
+
+            double mx = refx[k + 1] + dx[p];
+            double my = refy[k + 1] + dy[p];
+            double offset = hypot( dx[p], dy[p] );
+            furthest = offset > furthest ? offset : furthest;
+            glitched |= mx * mx + my * my < PTB_GLITCH_TOLERANCE * refmag2;
+        }
+
+        /* The series must hold to a fraction of the closest pixels' spacing,
+           and no pixel may escape among the iterations skipped. */
+        if ( !(error <= PTB_SERIES_TOLERANCE * spacing) || glitched
+             || sqrt( refmag2 ) + furthest >= 2 )
+        {
+            break;
+        }
+
+        ax = nax;
+        ay = nay;
+        bx = nbx;
+        by = nby;
+        cx = ncx;
+        cy = ncy;
+        series->skip = k + 1;
+        series->re[0] = ax;
+        series->im[0] = ay;
+        series->re[1] = bx;
+        series->im[1] = by;
+        series->re[2] = cx;
+        series->im[2] = cy;
+    }
+
+    return series->skip;
+}
+
+void PTB_PushPixel( SIMD_Batch* batch, const PTB_Series* series, int julia, double x, double y,
+                    uint32_t index )
+{
+    double dx = julia ? x : 0;
+    double dy = julia ? y : 0;
+    int iterations = 1;
+
+    if ( series && series->skip )
+    {
+        double ux = x / series->radius;
+        double uy = y / series->radius;
+        double sx = series->re[2] * ux - series->im[2] * uy + series->re[1];
+        double sy = series->re[2] * uy + series->im[2] * ux + series->im[1];
+        double xtemp = sx;
+        sx = sx * ux - sy * uy + series->re[0];
+        sy = xtemp * uy + sy * ux + series->im[0];
+        dx = sx * ux - sy * uy;
+        dy = sx * uy + sy * ux;
+        iterations = series->skip + 1;
+    }
+
+    if ( julia )
+    {
+        SIMD_PushPixel( batch, dx, dy, 0, 0, iterations, index );
+    }
+    else
+    {
+        SIMD_PushPixel( batch, dx, dy, x, y, iterations, index );
+    }
+}
+
+PTB_Table* PTB_CreateTable( void )
+{
+    return calloc( 1, sizeof(PTB_Table) );
+}
+
+void PTB_DestroyTable( PTB_Table* table )
+{
+    if ( table )
+    {
+        free( table->storage );
+        free( table );
+    }
+}
+
+int PTB_BuildTable( PTB_Table* table, const PTB_Reference* reference, double radius,
+                    PTB_CancelFunction cancelled, void* userdata )
+{
+    const double* refx = reference->zx;
+    const double* refy = reference->zy;
+
+    /* The single steps run from 1, as Z is 0 at 0, to the last point. */
+    int steps = reference->length - 2;
+    if ( steps < 0 )
+    {
+        steps = 0;
+    }
+    if ( 2 * steps > table->capacity )
+    {
+        PTB_Step* storage = realloc( table->storage, 2 * steps * sizeof(PTB_Step) );
+        if ( !storage )
+        {
+            return 0;
+        }
+        table->storage = storage;
+        table->capacity = 2 * steps;
+    }
+
+    PTB_Step* step = table->storage;
+    int j;
+    table->levels = 0;
+    for ( j = 0; j < steps; j++ )
+    {
+        double zx = refx[j + 1];
+        double zy = refy[j + 1];
+        step[j].ax = 2 * zx;
+        step[j].ay = 2 * zy;
+        step[j].bx = reference->julia ? 0 : 1;
+        step[j].by = 0;
+        step[j].radius = PTB_BLA_EPSILON * hypot( step[j].ax, step[j].ay );
+    }
+
+    int count = steps;
+    while ( count > 0 && table->levels < PTB_BLA_LEVELS )
+    {
+        if ( cancelled && cancelled( userdata ) )
+        {
+            table->levels = 0;
+            return 0;
+        }
+
+        table->step[table->levels] = step;
+        table->count[table->levels] = count;
+        table->levels++;
+
+        /* Each map of the next level is x followed by y. */
+        PTB_Step* next = step + count;
+        for ( j = 0; j < count / 2; j++ )
+        {
+            const PTB_Step* x = &step[2 * j];
+            const PTB_Step* y = &step[2 * j + 1];
+            next[j].ax = y->ax * x->ax - y->ay * x->ay;
+            next[j].ay = y->ax * x->ay + y->ay * x->ax;
+            next[j].bx = y->ax * x->bx - y->ay * x->by + y->bx;
+            next[j].by = y->ax * x->by + y->ay * x->bx + y->by;
+            double reach = (y->radius - hypot( x->bx, x->by ) * radius) / hypot( x->ax, x->ay );
+            reach = reach > 0 ? reach : 0;
+            next[j].radius = x->radius < reach ? x->radius : reach;
+        }
+        step = next;
+        count /= 2;
+    }
+    return 1;
+}
+
+/* The longest map from orbit position k for an offset of size up to d
+   that goes no more than left iterations, or NULL. */
+static const PTB_Step* findStep( const PTB_Table* table, int k, double d, int left, int* level )
+{
+    if ( k < 1 || !table->levels )
+    {
+        return NULL;
+    }
+
+    /* Maps of a level start every 2^level positions. */
+    int l = table->levels - 1;
+    if ( k > 1 && __builtin_ctz( k - 1 ) < l )
+    {
+        l = __builtin_ctz( k - 1 );
+    }
+    for ( ; l >= 0; l-- )
+    {
+        int j = (k - 1) >> l;
+        if ( j < table->count[l] && (1 << l) <= left && d < table->step[l][j].radius )
+        {
+            *level = l;
+            return &table->step[l][j];
+        }
+    }
+    return NULL;
+}
+
+/* runPixel along the table. Returns the steps taken, each map being one. */
+static uint64_t runPixelBLA( const PTB_Reference* reference, const PTB_Table* table, double dx,
+                             double dy, double dcx, double dcy, int k, uint16_t iterations,
+                             uint16_t max, double tolerance, uint32_t index, SIMD_BatchOutput* out,
+                             uint64_t* skipped, uint64_t* rebases )
+{
+    const double* refx = reference->zx;
+    const double* refy = reference->zy;
+    int length = reference->length;
+    int julia = reference->julia;
+    uint64_t steps = 0;
+    double zx = refx[k] + dx;
+    double zy = refy[k] + dy;
+
+    while ( zx * zx + zy * zy < 2 * 2 && iterations < max )
+    {
+        if ( !julia && k > 0 && (zx * zx + zy * zy < dx * dx + dy * dy || k + 1 >= length) )
+        {
+            dx = zx;
+            dy = zy;
+            k = 0;
+            (*rebases)++;
+        }
+        else if ( zx * zx + zy * zy < tolerance * (refx[k] * refx[k] + refy[k] * refy[k]) )
+        {
+            iterations = 0;
+            break;
+        }
+
+        /* |dx| + |dy| bounds |d| without squaring it, which underflows. */
+        int level;
+        const PTB_Step* step = findStep( table, k, fabs( dx ) + fabs( dy ), max - iterations, &level );
+        if ( step )
+        {
+            double xtemp = dx;
+            dx = step->ax * dx - step->ay * dy + step->bx * dcx - step->by * dcy;
+            dy = step->ax * dy + step->ay * xtemp + step->bx * dcy + step->by * dcx;
+            k += 1 << level;
+            iterations += 1 << level;
+            *skipped += (1 << level) - 1;
+            zx = refx[k] + dx;
+            zy = refy[k] + dy;
+        }
+        else if ( k + 1 < length )
+        {
+            double tx = 2 * refx[k] + dx;
+            double ty = 2 * refy[k] + dy;
+            double xtemp = dx;
+            dx = tx * dx - ty * dy + dcx;
+            dy = tx * dy + ty * xtemp + dcy;
+            k++;
+            zx = refx[k] + dx;
+            zy = refy[k] + dy;
+            iterations++;
+        }
+        else
+        {
+            double xtemp = zx;
+            zx = zx * zx - zy * zy + reference->cx + dcx;
+            zy = 2 * xtemp * zy + reference->cy + dcy;
+            iterations++;
+        }
+        steps++;
+    }
+
+    out->iter[index] = iterations;
+    out->zx[index] = zx;
+    out->zy[index] = zy;
+    return steps;
+}
+
+/* Carries one pixel on from offset (dx, dy) after iterations iterations,
+   which is k into the orbit, and stores its results. A positive tolerance
+   detects glitches. Returns the steps taken. */
+static uint64_t runPixel( const PTB_Reference* reference, double dx, double dy, double dcx,
+                          double dcy, int k, uint16_t iterations, uint16_t max, double tolerance,
+                          uint32_t index, SIMD_BatchOutput* out )
+{
+    const double* refx = reference->zx;
+    const double* refy = reference->zy;
+    int length = reference->length;
+    uint64_t steps = 0;
+    double zx = refx[k] + dx;
+    double zy = refy[k] + dy;
+
+    while ( zx * zx + zy * zy < 2 * 2 && iterations < max )
+    {
+        if ( zx * zx + zy * zy < tolerance * (refx[k] * refx[k] + refy[k] * refy[k]) )
+        {
+            iterations = 0;
+            break;
+        }
+
+        if ( k + 1 < length )
+        {
+            double tx = 2 * refx[k] + dx;
+            double ty = 2 * refy[k] + dy;
+            double xtemp = dx;
+            dx = tx * dx - ty * dy + dcx;
+            dy = tx * dy + ty * xtemp + dcy;
+            k++;
+            zx = refx[k] + dx;
+            zy = refy[k] + dy;
+        }
+        else
+        {
+            double xtemp = zx;
+            zx = zx * zx - zy * zy + reference->cx + dcx;
+            zy = 2 * xtemp * zy + reference->cy + dcy;
+        }
+        iterations++;
+        steps++;
+    }
+
+    out->iter[index] = iterations;
+    out->zx[index] = zx;
+    out->zy[index] = zy;
+    return steps;
+}
+
+#if SIMD_AVX2_BUILT
+
+/* As the batch engine's AVX2 kernel, each lane follows runPixel exactly,
+   with the orbit gathered at each lane's own position in it. A lane that
+   reaches the end of the orbit is finished by runPixel. */
+__attribute__((target("avx2")))
+static void runBatchAVX2( const PTB_Reference* reference, SIMD_Batch* batch, uint16_t max,
+                          double tolerance, SIMD_BatchOutput* out, SIMD_BatchStats* stats )
+{
+    double ldx[SIMD_LANES], ldy[SIMD_LANES], ldcx[SIMD_LANES], ldcy[SIMD_LANES];
+    double lzx[SIMD_LANES], lzy[SIMD_LANES];
+    int64_t lit[SIMD_LANES], lk[SIMD_LANES];
+    int64_t occupied[SIMD_LANES];
+    int slot[SIMD_LANES];
+
+    const double* refx = reference->zx;
+    const double* refy = reference->zy;
+    const __m256d four = _mm256_set1_pd( 2 * 2 );
+    const __m256d two = _mm256_set1_pd( 2 );
+    const __m256i limit = _mm256_set1_epi64x( max );
+    const __m256i last = _mm256_set1_epi64x( reference->length - 1 );
+    const __m256d tol = _mm256_set1_pd( tolerance );
+
+    uint64_t lanesteps = 0;
+    uint64_t activesteps = 0;
+    int next = 0;
+    int lane;
+
+    for ( lane = 0; lane < SIMD_LANES; lane++ )
+    {
+        ldx[lane] = ldy[lane] = ldcx[lane] = ldcy[lane] = 0;
+        lzx[lane] = lzy[lane] = 0;
+        lit[lane] = max;
+        lk[lane] = 0;
+        slot[lane] = -1;
+    }
+
+    for (;;)
+    {
+        int live = 0;
+        for ( lane = 0; lane < SIMD_LANES; lane++ )
+        {
+            for (;;)
+            {
+                if ( slot[lane] >= 0 )
+                {
+                    uint32_t index = batch->index[slot[lane]];
+                    double refmag2 = refx[lk[lane]] * refx[lk[lane]] + refy[lk[lane]] * refy[lk[lane]];
+                    double mag2 = lzx[lane] * lzx[lane] + lzy[lane] * lzy[lane];
+                    if ( mag2 < 2 * 2 && lit[lane] < max && !(mag2 < tolerance * refmag2) )
+                    {
+                        if ( lk[lane] + 1 < reference->length )
+                        {
+                            live |= 1 << lane;
+                            break;
+                        }
+                        uint64_t steps = runPixel( reference, ldx[lane], ldy[lane], ldcx[lane],
+                                                   ldcy[lane], (int)lk[lane], (uint16_t)lit[lane],
+                                                   max, tolerance, index, out );
+                        lanesteps += steps;
+                        activesteps += steps;
+                    }
+                    else
+                    {
+                        out->iter[index] = mag2 < 2 * 2 && lit[lane] < max ? 0 : (uint16_t)lit[lane];
+                        out->zx[index] = lzx[lane];
+                        out->zy[index] = lzy[lane];
+                    }
+                    slot[lane] = -1;
+                }
+
+                if ( next >= batch->count )
+                {
+                    break;
+                }
+
+                ldx[lane] = batch->zx[next];
+                ldy[lane] = batch->zy[next];
+                ldcx[lane] = batch->cx[next];
+                ldcy[lane] = batch->cy[next];
+                lit[lane] = batch->iter[next];
+                lk[lane] = lit[lane] - 1;
+                lzx[lane] = refx[lk[lane]] + ldx[lane];
+                lzy[lane] = refy[lk[lane]] + ldy[lane];
+                slot[lane] = next++;
+            }
+            occupied[lane] = slot[lane] >= 0 ? -1 : 0;
+        }
+
+        if ( !live )
+        {
+            break;
+        }
+
+        __m256d dx = _mm256_loadu_pd( ldx );
+        __m256d dy = _mm256_loadu_pd( ldy );
+        __m256d dcx = _mm256_loadu_pd( ldcx );
+        __m256d dcy = _mm256_loadu_pd( ldcy );
+        __m256d zx = _mm256_loadu_pd( lzx );
+        __m256d zy = _mm256_loadu_pd( lzy );
+        __m256i iterations = _mm256_loadu_si256( (const __m256i*)lit );
+        __m256i k = _mm256_loadu_si256( (const __m256i*)lk );
+        __m256d active = _mm256_castsi256_pd( _mm256_loadu_si256( (const __m256i*)occupied ) );
+
+        /* The orbit point each lane is at, carried from one step to the next. */
+        __m256d refzx = _mm256_i64gather_pd( refx, k, 8 );
+        __m256d refzy = _mm256_i64gather_pd( refy, k, 8 );
+
+        int mask = live;
+        while ( mask == live )
+        {
+            __m256d tx = _mm256_add_pd( _mm256_mul_pd( two, refzx ), dx );
+            __m256d ty = _mm256_add_pd( _mm256_mul_pd( two, refzy ), dy );
+            __m256d xtemp = _mm256_add_pd( _mm256_sub_pd( _mm256_mul_pd( tx, dx ), _mm256_mul_pd( ty, dy ) ), dcx );
+            __m256d ytemp = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( tx, dy ), _mm256_mul_pd( ty, dx ) ), dcy );
+            dx = _mm256_blendv_pd( dx, xtemp, active );
+            dy = _mm256_blendv_pd( dy, ytemp, active );
+
+            /* Active lanes hold all ones, so subtracting the mask counts them. */
+            k = _mm256_sub_epi64( k, _mm256_castpd_si256( active ) );
+            iterations = _mm256_sub_epi64( iterations, _mm256_castpd_si256( active ) );
+
+            refzx = _mm256_i64gather_pd( refx, k, 8 );
+            refzy = _mm256_i64gather_pd( refy, k, 8 );
+            zx = _mm256_blendv_pd( zx, _mm256_add_pd( refzx, dx ), active );
+            zy = _mm256_blendv_pd( zy, _mm256_add_pd( refzy, dy ), active );
+
+            lanesteps += SIMD_LANES;
+            activesteps += __builtin_popcount( mask );
+
+            __m256d mag2 = _mm256_add_pd( _mm256_mul_pd( zx, zx ), _mm256_mul_pd( zy, zy ) );
+            __m256d refmag2 = _mm256_add_pd( _mm256_mul_pd( refzx, refzx ), _mm256_mul_pd( refzy, refzy ) );
+            active = _mm256_and_pd( active, _mm256_cmp_pd( mag2, four, _CMP_LT_OQ ) );
+            active = _mm256_andnot_pd( _mm256_cmp_pd( mag2, _mm256_mul_pd( tol, refmag2 ), _CMP_LT_OQ ), active );
+            active = _mm256_and_pd( active, _mm256_castsi256_pd( _mm256_cmpgt_epi64( limit, iterations ) ) );
+            active = _mm256_and_pd( active, _mm256_castsi256_pd( _mm256_cmpgt_epi64( last, k ) ) );
+            mask = _mm256_movemask_pd( active );
+        }
+
+        _mm256_storeu_pd( ldx, dx );
+        _mm256_storeu_pd( ldy, dy );
+        _mm256_storeu_pd( lzx, zx );
+        _mm256_storeu_pd( lzy, zy );
+        _mm256_storeu_si256( (__m256i*)lit, iterations );
+        _mm256_storeu_si256( (__m256i*)lk, k );
+    }
+
+    stats->lanesteps += lanesteps;
+    stats->activesteps += activesteps;
+}
+
+#endif
+
+void PTB_RunBatch( const PTB_Reference* reference, SIMD_Batch* batch, uint16_t max, int glitches,
+                   SIMD_BatchOutput* out, SIMD_BatchStats* stats )
+{
+    double tolerance = glitches ? PTB_GLITCH_TOLERANCE : 0;
+#if SIMD_AVX2_BUILT
+    if ( SIMD_HasAVX2( ) )
+    {
+        runBatchAVX2( reference, batch, max, tolerance, out, stats );
+        batch->count = 0;
+        return;
+    }
+#endif
+
+    uint64_t steps = 0;
+    int n;
+    for ( n = 0; n < batch->count; n++ )
+    {
+        uint16_t iterations = batch->iter[n];
+        steps += runPixel( reference, batch->zx[n], batch->zy[n], batch->cx[n], batch->cy[n],
+                           iterations - 1, iterations, max, tolerance, batch->index[n], out );
+    }
+
+    batch->count = 0;
+    stats->lanesteps += steps;
+    stats->activesteps += steps;
+}
+
+void PTB_RunBatchBLA( const PTB_Reference* reference, const PTB_Table* table, SIMD_Batch* batch,
+                      uint16_t max, int glitches, SIMD_BatchOutput* out, SIMD_BatchStats* stats,
+                      uint64_t* skipped, uint64_t* rebases )
+{
+    double tolerance = glitches && reference->julia ? PTB_GLITCH_TOLERANCE : 0;
+    uint64_t steps = 0;
+    int n;
+    for ( n = 0; n < batch->count; n++ )
+    {
+        uint16_t iterations = batch->iter[n];
+        steps += runPixelBLA( reference, table, batch->zx[n], batch->zy[n], batch->cx[n],
+                              batch->cy[n], iterations - 1, iterations, max, tolerance,
+                              batch->index[n], out, skipped, rebases );
+    }
+
+    batch->count = 0;
+    stats->lanesteps += steps;
+    stats->activesteps += steps;
+}
@@ -0,0 +1,359 @@
+/*
+
+    Implementation file for the background plotter.
+    A single thread takes the latest request, builds its palette and
+    renders it pass by pass into a back buffer. A finished pass is swapped
+    with the front buffer, which the event loop uploads to a texture while
+    the next pass renders. A new request cancels the render in progress,
+    and passes of earlier requests are never shown.
+
+*/
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "palette.h"
+#include "plotter.h"
+
+struct _Plotter
+{
+    uint16_t w, h;
+    int previewshift;
+    SDL_Thread* thread;
+    SDL_mutex* lock;
+    SDL_cond* wake;
+
+    /* Guarded by lock. serial counts the requests submitted, and the
+       pass is fresh until the event loop has locked it once. */
+    PLT_Request request;
+    Uint64 submitted;
+    int serial;
+    int pending;
+    int quit;
+    Uint32* front;
+    PLT_Pass pass;
+    int passserial;
+    int fresh;
+
+    /* Only touched by the plotter thread. complete is set while the
+       renderer's retained frame is the full pass of the last request. */
+    Uint32* back;
+    PAL_Palette* palette;
+    SDL_PixelFormat* format;
+    int complete;
+};
+
+static Uint32 eventtype = (Uint32)-1;
+
+static double millisecondsSince( Uint64 start )
+{
+    return (SDL_GetPerformanceCounter( ) - start) * 1000.0 / SDL_GetPerformanceFrequency( );
+}
+
+/* Makes the back buffer the front one and announces it, unless a newer
+   request came in while it rendered. Returns 0 in that case. */
+static int publishPass( PLT_Plotter* plotter, int serial, const PLT_Pass* pass, Uint64 start,
+                        double* firstms )
+{
+    SDL_LockMutex( plotter->lock );
+    if ( serial != plotter->serial )
+    {
+        SDL_UnlockMutex( plotter->lock );
+        return 0;
+    }
+
+    Uint32* swap = plotter->front;
+    plotter->front = plotter->back;
+    plotter->back = swap;
+
+    plotter->pass = *pass;
+    plotter->pass.pixels = plotter->front;
+    plotter->pass.passms = millisecondsSince( start );
+    if ( *firstms < 0 )
+    {
+        *firstms = plotter->pass.passms;
+    }
+    plotter->pass.firstms = *firstms;
+    plotter->passserial = serial;
+    plotter->fresh = 1;
+    SDL_UnlockMutex( plotter->lock );
+
+    SDL_Event event;
+    SDL_zero( event );
+    event.type = eventtype;
+    SDL_PushEvent( &event );
+    return 1;
+}
+
+static int updatePalette( PLT_Plotter* plotter, const PLT_Request* request )
+{
+    if ( !plotter->format || plotter->format->format != request->format )
+    {
+        SDL_FreeFormat( plotter->format );
+        plotter->format = SDL_AllocFormat( request->format );
+        if ( !plotter->format )
+        {
+            return 0;
+        }
+    }
+
+    return PAL_UpdatePalette( plotter->palette, plotter->format, request->maxiter,
+                              request->palette_mode );
+}
+
+static void plotRequest( PLT_Plotter* plotter, const PLT_Request* request, int serial,
+                         Uint64 start )
+{
+    if ( !updatePalette( plotter, request ) )
+    {
+        printf( "Failed to build the palette.\n" );
+        return;
+    }
+
+    SetRenderStrategy( request->strategy );
+    SetPeriodicityCheck( request->periodicity );
+    SetDeepApproximation( request->approximation );
+
+    SpanColorizer colorizer = { PAL_ColorSpan, sizeof(Uint32), 0, plotter->palette };
+    double firstms = -1;
+
+    PLT_Pass pass;
+    pass.pitch = plotter->w * sizeof(Uint32);
+    pass.w = plotter->w;
+    pass.h = plotter->h;
+    pass.shift = 0;
+    pass.offx = 0;
+    pass.offy = 0;
+
+    /* Only the colors changed, so reuse the last plot's escape counts. */
+    if ( request->recolor && plotter->complete )
+    {
+        RecolorSpans( plotter->back, pass.pitch, pass.w, pass.h, &colorizer );
+        GetRenderStats( &pass.stats );
+        pass.recolor = 1;
+        publishPass( plotter, serial, &pass, start, &firstms );
+        return;
+    }
+
+    plotter->complete = 0;
+    pass.recolor = 0;
+    if ( request->realtime )
+    {
+        uint16_t maxiter = request->maxiter;
+        int plotted;
+        if ( request->julia )
+        {
+            plotted = PlotJuliaRealtime( &request->c, plotter->back, pass.pitch, pass.w, pass.h,
+                                         &request->view, &maxiter, PLT_REALTIME_TOLERANCE,
+                                         &colorizer );
+        }
+        else
+        {
+            plotted = PlotMandelbrotRealtime( plotter->back, pass.pitch, pass.w, pass.h,
+                                              &request->view, &maxiter, PLT_REALTIME_TOLERANCE,
+                                              &colorizer );
+        }
+        if ( !plotted )
+        {
+            printf( "Failed to plot the view.\n" );
+            return;
+        }
+
+        GetRenderStats( &pass.stats );
+        publishPass( plotter, serial, &pass, start, &firstms );
+        return;
+    }
+
+    for ( pass.shift = request->progressive ? plotter->previewshift : 0; pass.shift >= 0; pass.shift-- )
+    {
+        FractalView view = request->view;
+        pass.w = plotter->w;
+        pass.h = plotter->h;
+        pass.offx = 0;
+        pass.offy = 0;
+        if ( pass.shift > 0 )
+        {
+            PreviewView( &view, &request->view, pass.shift, &pass.offx, &pass.offy );
+            pass.w = (pass.w + pass.offx + (1 << pass.shift) - 1) >> pass.shift;
+            pass.h = (pass.h + pass.offy + (1 << pass.shift) - 1) >> pass.shift;
+        }
+
+        uint16_t maxiter = request->maxiter;
+        int plotted;
+        if ( request->julia )
+        {
+            plotted = PlotJuliaView( &request->c, plotter->back, pass.pitch, pass.w, pass.h,
+                                     &view, &maxiter, &colorizer );
+        }
+        else
+        {
+            plotted = PlotMandelbrotView( plotter->back, pass.pitch, pass.w, pass.h,
+                                          &view, &maxiter, &colorizer );
+        }
+        if ( !plotted )
+        {
+            printf( "Failed to plot the view.\n" );
+            return;
+        }
+
+        GetRenderStats( &pass.stats );
+        if ( !publishPass( plotter, serial, &pass, start, &firstms ) )
+        {
+            return;
+        }
+    }
+    plotter->complete = 1;
+}
+
+static int plotterThread( void* data )
+{
+    PLT_Plotter* plotter = data;
+
+    SDL_LockMutex( plotter->lock );
+    for (;;)
+    {
+        while ( !plotter->quit && !plotter->pending )
+        {
+            SDL_CondWait( plotter->wake, plotter->lock );
+        }
+        if ( plotter->quit )
+        {
+            break;
+        }
+
+        PLT_Request request = plotter->request;
+        int serial = plotter->serial;
+        Uint64 start = plotter->submitted;
+        plotter->pending = 0;
+
+        /* Read with the request, so that a submit made before the render
+           starts cancels it, rather than being taken in by it. */
+        int generation = GetRenderGeneration( );
+        SDL_UnlockMutex( plotter->lock );
+
+        SetRenderGeneration( generation );
+        plotRequest( plotter, &request, serial, start );
+        SetRenderGeneration( -1 );
+
+        SDL_LockMutex( plotter->lock );
+    }
+    SDL_UnlockMutex( plotter->lock );
+
+    return 0;
+}
+
+PLT_Plotter* PLT_CreatePlotter( uint16_t w, uint16_t h, int previewshift )
+{
+    if ( eventtype == (Uint32)-1 )
+    {
+        eventtype = SDL_RegisterEvents( 1 );
+        if ( eventtype == (Uint32)-1 )
+        {
+            return NULL;
+        }
+    }
+
+    PLT_Plotter* plotter = calloc( 1, sizeof(PLT_Plotter) );
+    if ( !plotter )
+    {
+        return NULL;
+    }
+
+    plotter->w = w;
+    plotter->h = h;
+    plotter->previewshift = previewshift;
+    plotter->front = malloc( (size_t)w * h * sizeof(Uint32) );
+    plotter->back = malloc( (size_t)w * h * sizeof(Uint32) );
+    plotter->palette = PAL_CreatePalette( );
+    plotter->lock = SDL_CreateMutex( );
+    plotter->wake = SDL_CreateCond( );
+    if ( !plotter->front || !plotter->back || !plotter->palette || !plotter->lock
+         || !plotter->wake )
+    {
+        PLT_DestroyPlotter( plotter );
+        return NULL;
+    }
+
+    plotter->thread = SDL_CreateThread( plotterThread, "plotter", plotter );
+    if ( !plotter->thread )
+    {
+        PLT_DestroyPlotter( plotter );
+        return NULL;
+    }
+
+    return plotter;
+}
+
+void PLT_DestroyPlotter( PLT_Plotter* plotter )
+{
+    if ( !plotter )
+    {
+        return;
+    }
+
+    if ( plotter->thread )
+    {
+        SDL_LockMutex( plotter->lock );
+        plotter->quit = 1;
+        CancelRender( );
+        SDL_CondSignal( plotter->wake );
+        SDL_UnlockMutex( plotter->lock );
+        SDL_WaitThread( plotter->thread, NULL );
+    }
+
+    if ( plotter->wake )
+    {
+        SDL_DestroyCond( plotter->wake );
+    }
+    if ( plotter->lock )
+    {
+        SDL_DestroyMutex( plotter->lock );
+    }
+    if ( plotter->palette )
+    {
+        PAL_DestroyPalette( plotter->palette );
+    }
+    SDL_FreeFormat( plotter->format );
+    free( plotter->front );
+    free( plotter->back );
+    free( plotter );
+}
+
+Uint32 PLT_GetEventType( void )
+{
+    return eventtype;
+}
+
+void PLT_Submit( PLT_Plotter* plotter, const PLT_Request* request )
+{
+    SDL_LockMutex( plotter->lock );
+    plotter->request = *request;
+    plotter->submitted = SDL_GetPerformanceCounter( );
+    plotter->serial++;
+    plotter->pending = 1;
+    plotter->fresh = 0;
+
+    /* Cancelling under the lock means a render of this request, whose
+       generation is read under the lock, is not cancelled by it. */
+    CancelRender( );
+    SDL_CondSignal( plotter->wake );
+    SDL_UnlockMutex( plotter->lock );
+}
+
+int PLT_LockPass( PLT_Plotter* plotter, PLT_Pass* pass )
+{
+    SDL_LockMutex( plotter->lock );
+    if ( !plotter->fresh || plotter->passserial != plotter->serial )
+    {
+        SDL_UnlockMutex( plotter->lock );
+        return 0;
+    }
+
+    *pass = plotter->pass;
+    plotter->fresh = 0;
+    return 1;
+}
+
+void PLT_UnlockPass( PLT_Plotter* plotter )
+{
+    SDL_UnlockMutex( plotter->lock );
+}
@@ -0,0 +1,252 @@
+/*
+
+    Implementation file for the persistent worker pool.
+    POOL_Run splits its task indices into one contiguous range per worker.
+    Each worker takes tasks from the front of its own range, and a worker
+    whose range runs dry steals the back half of another worker's range.
+    The thread calling POOL_Run works as worker 0.
+
+*/
+
+#include "stdlib.h"
+#include "pool.h"
+
+/* A worker's range of pending tasks, padded so that neighbouring ranges do
+   not share a cache line. */
+typedef struct
+{
+    SDL_SpinLock lock;
+    int front;
+    int back;
+    char pad[64 - sizeof(SDL_SpinLock) - 2 * sizeof(int)];
+} POOL_Range;
+
+struct _Pool
+{
+    int threads;
+    SDL_Thread** handles;
+    POOL_Range* ranges;
+
+    SDL_mutex* lock;
+    SDL_cond* wake;
+    SDL_cond* done;
+    int generation;
+    int busy;
+    int quit;
+
+    POOL_TaskFunction func;
+    void* data;
+};
+
+typedef struct
+{
+    POOL_Pool* pool;
+    int worker;
+} POOL_Start;
+
+static int takeTask( POOL_Range* range )
+{
+    int task = -1;
+    SDL_AtomicLock( &range->lock );
+    if ( range->front < range->back )
+    {
+        task = range->front++;
+    }
+    SDL_AtomicUnlock( &range->lock );
+    return task;
+}
+
+/* Moves the back half of another worker's range into the worker's own. */
+static int stealTasks( POOL_Pool* pool, int worker )
+{
+    int i;
+    for ( i = 1; i < pool->threads; i++ )
+    {
+        POOL_Range* victim = &pool->ranges[(worker + i) % pool->threads];
+        int front = 0, back = 0;
+
+        SDL_AtomicLock( &victim->lock );
+        int pending = victim->back - victim->front;
+        if ( pending > 0 )
+        {
+            back = victim->back;
+            victim->back -= (pending + 1) / 2;
+            front = victim->back;
+        }
+        SDL_AtomicUnlock( &victim->lock );
+
+        if ( front < back )
+        {
+            POOL_Range* own = &pool->ranges[worker];
+            SDL_AtomicLock( &own->lock );
+            own->front = front;
+            own->back = back;
+            SDL_AtomicUnlock( &own->lock );
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void work( POOL_Pool* pool, int worker )
+{
+    POOL_Range* own = &pool->ranges[worker];
+    do
+    {
+        int task;
+        while ( (task = takeTask( own )) >= 0 )
+        {
+            (*pool->func)( task, worker, pool->data );
+        }
+    } while ( stealTasks( pool, worker ) );
+}
+
+static int workerThread( void* data )
+{
+    POOL_Start* start = data;
+    POOL_Pool* pool = start->pool;
+    int worker = start->worker;
+    free( start );
+
+    int seen = 0;
+    SDL_LockMutex( pool->lock );
+    for (;;)
+    {
+        while ( !pool->quit && pool->generation == seen )
+        {
+            SDL_CondWait( pool->wake, pool->lock );
+        }
+        if ( pool->quit )
+        {
+            break;
+        }
+        seen = pool->generation;
+        SDL_UnlockMutex( pool->lock );
+
+        work( pool, worker );
+
+        SDL_LockMutex( pool->lock );
+        if ( --pool->busy == 0 )
+        {
+            SDL_CondSignal( pool->done );
+        }
+    }
+    SDL_UnlockMutex( pool->lock );
+
+    return 0;
+}
+
+POOL_Pool* POOL_CreatePool( int threads )
+{
+    if ( threads < 1 )
+    {
+        threads = 1;
+    }
+
+    POOL_Pool* pool = calloc( 1, sizeof(POOL_Pool) );
+    if ( !pool )
+    {
+        return NULL;
+    }
+
+    pool->threads = threads;
+    pool->handles = calloc( threads, sizeof(SDL_Thread*) );
+    pool->ranges = calloc( threads, sizeof(POOL_Range) );
+    pool->lock = SDL_CreateMutex( );
+    pool->wake = SDL_CreateCond( );
+    pool->done = SDL_CreateCond( );
+    if ( !pool->handles || !pool->ranges || !pool->lock || !pool->wake || !pool->done )
+    {
+        POOL_DestroyPool( pool );
+        return NULL;
+    }
+
+    int i;
+    for ( i = 1; i < threads; i++ )
+    {
+        POOL_Start* start = malloc( sizeof(POOL_Start) );
+        if ( !start )
+        {
+            break;
+        }
+        start->pool = pool;
+        start->worker = i;
+
+        pool->handles[i] = SDL_CreateThread( workerThread, "FractalWorker", start );
+        if ( !pool->handles[i] )
+        {
+            free( start );
+            break;
+        }
+    }
+
+    /* Run with however many threads could be started. */
+    pool->threads = i;
+
+    return pool;
+}
+
+int POOL_GetThreadCount( POOL_Pool* pool )
+{
+    return pool->threads;
+}
+
+void POOL_Run( POOL_Pool* pool, int tasks, POOL_TaskFunction func, void* data )
+{
+    pool->func = func;
+    pool->data = data;
+
+    int i;
+    for ( i = 0; i < pool->threads; i++ )
+    {
+        pool->ranges[i].front = (int)((int64_t)tasks * i / pool->threads);
+        pool->ranges[i].back = (int)((int64_t)tasks * (i + 1) / pool->threads);
+    }
+
+    SDL_LockMutex( pool->lock );
+    pool->busy = pool->threads - 1;
+    pool->generation++;
+    SDL_CondBroadcast( pool->wake );
+    SDL_UnlockMutex( pool->lock );
+
+    work( pool, 0 );
+
+    SDL_LockMutex( pool->lock );
+    while ( pool->busy > 0 )
+    {
+        SDL_CondWait( pool->done, pool->lock );
+    }
+    SDL_UnlockMutex( pool->lock );
+}
+
+void POOL_DestroyPool( POOL_Pool* pool )
+{
+    if ( !pool )
+    {
+        return;
+    }
+
+    if ( pool->lock )
+    {
+        SDL_LockMutex( pool->lock );
+        pool->quit = 1;
+        SDL_CondBroadcast( pool->wake );
+        SDL_UnlockMutex( pool->lock );
+    }
+
+    int i;
+    for ( i = 1; pool->handles && i < pool->threads; i++ )
+    {
+        if ( pool->handles[i] )
+        {
+            SDL_WaitThread( pool->handles[i], NULL );
+        }
+    }
+
+    if ( pool->lock ) SDL_DestroyMutex( pool->lock );
+    if ( pool->wake ) SDL_DestroyCond( pool->wake );
+    if ( pool->done ) SDL_DestroyCond( pool->done );
+    free( pool->handles );
+    free( pool->ranges );
+    free( pool );
+}
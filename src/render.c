@@ -0,0 +1,1763 @@
+/*
+
+    Implementation file for the tiled, multithreaded renderer.
+    A frame is split into RND_TILE_SIZE square tiles, which a persistent
+    worker pool iterates with the batch engine and colors straight into
+    the caller's buffer. Every pixel is computed from the same coordinates
+    regardless of which worker takes its tile, so the output is identical
+    to a single-threaded render. Each tile's results are also kept in a
+    frame-sized buffer, so the frame can be recolored without iterating.
+
+    Tiles are rendered with one of the RENDER_ strategies:
+    brute force iterates every pixel;
+    subdivision (Mariani-Silver) iterates the border of a rectangle, fills
+    the rectangle if the whole border has one count, and otherwise splits
+    it into four and repeats;
+    boundary tracing follows the edges between regions of equal count,
+    starting from the tile's border, and flood-fills what they enclose.
+
+    The previous frame is kept as well. Where a pixel of the new frame
+    sits at exactly the coordinates of a computed pixel of the previous
+    one, as every other pixel does after a 2x zoom of a FractalView, its
+    count is copied over before the tile is rendered, and the strategies
+    treat it as known. If the new frame has a higher maxiter, the pixels
+    the previous one stopped at its maxiter carry on from their final z
+    instead of starting over.
+
+    Tiles of a FractalView are aligned to its grid and kept in the tile
+    cache, which makes them a quadtree over the zoom levels: a cached tile
+    is used whole, and a missing tile takes a quarter of its pixels from
+    its cached parent tile of the level above. Tiles are keyed by the
+    strategy and periodicity setting too, since both change the counts.
+    The periodicity check's tolerance scales with the pixels, so a count
+    of maxiter it may have stopped early is only taken from a frame
+    checked at a tolerance no looser, which a parent tile never is.
+
+    A preview is a view shifted a few levels up, so its tiles are the
+    ancestors of the full view's, and its samples reach the finer passes
+    through the cache. The frame of a preview is not kept as the previous
+    frame: the passes after it reuse the last frame that was not one.
+
+    CancelRender may be called from another thread to abandon a render.
+    A render belongs to the generation set by SetRenderGeneration, so that
+    a caller can tie it to the request it was read with, or else to the
+    one it starts in. The reference orbit and its tables are checked
+    against it as they are worked out, and workers before each tile. The
+    tiles they skip are marked as not computed in the frame, so nothing
+    reuses them. Like a preview, a cancelled frame is not kept as the
+    previous frame; the tiles it did finish are in the cache.
+
+    For real-time zooming, after XaoS, RND_SnapToFrame moves the columns
+    and rows of a frame onto those of the frame it will reuse where they
+    are close enough. Only the columns and rows too far from any are
+    iterated, and every pixel is still exact for the point it sits at.
+
+    Far past the precision of doubles, a job is perturbed: its coordinates are
+    offsets from a reference point, whose orbit is computed in high
+    precision before the tiles start, and the batches are iterated off it
+    by the perturbation kernel instead. The orbit is kept, so the passes of
+    a progressive plot and a raised maxiter do not compute it again.
+    Every pixel starts after the iterations that series approximation
+    skips for the whole frame, fitted to a grid of probe pixels, or with
+    bilinear approximation, jumps along a table built over the orbit for
+    the frame.
+    Pixels that glitch off it come out with a count of 0, which the
+    strategies never fill with: they treat a glitched pixel as the edge of
+    every region, so that the pixels around it are iterated too, and the
+    pixels of count 0 are only ever ones that glitched. Once the tiles are
+    done, the largest connected patch of them gets a secondary reference at
+    the glitched pixel nearest its middle, and all the glitched pixels are
+    iterated again off that; this repeats until none are left, the last
+    reference allowed being used without glitch detection.
+
+    Short of that depth, 106 bits are enough to iterate every pixel by
+    itself, so a job can be iterated in double-double arithmetic instead.
+    Its coordinates are the same offsets from a reference point, added to
+    it in double-double as each pixel starts. There is no orbit to compute
+    and nothing to glitch.
+
+*/
+
+#include "string.h"
+#include "SDL.h"
+#include "render.h"
+#include "simd.h"
+#include "pool.h"
+#include "tilecache.h"
+#include "perturb.h"
+#include "ddouble.h"
+
+/* Rectangles no wider or taller than this are iterated whole rather than
+   subdivided further. */
+#define RND_MIN_SUBDIVIDE 6
+#define RND_MAX_RECTS (RND_TILE_SIZE * RND_TILE_SIZE / 4)
+
+/* Series approximation is fitted to a grid of this many probes a side. */
+#define RND_SERIES_GRID 5
+
+/* A tile's position and size in the frame, which it may stick out of, its
+   pixel coordinates, and for a FractalView, its grid tile. */
+typedef struct
+{
+    int x, y, w, h;
+    const double* xs;
+    const double* ys;
+    int64_t tx, ty;
+} RND_Tile;
+
+/* An inclusive rectangle of pixels within a tile. */
+typedef struct
+{
+    int x0, y0, x1, y1;
+} RND_Rect;
+
+/* Per-pixel flags of the tile being rendered. */
+#define RND_KNOWN 1     /* Iterated, queued for iteration, or filled */
+#define RND_TRACED 2    /* Added to the boundary tracer's scan list */
+#define RND_ITERATED 4  /* Queued for the batch engine, so z is available */
+#define RND_EXACT 8     /* Iterated or tested rather than filled */
+
+/* Scratch space owned by one worker. */
+typedef struct
+{
+    SIMD_Batch* batch;
+    SIMD_BatchOutput output;
+    uint16_t* iterations;
+    double* zx;
+    double* zy;
+    uint8_t* known;
+    uint8_t* cycled;
+    RND_Rect* rects;
+    uint16_t* scan;
+    uint8_t* flags;
+    double xs[RND_TILE_SIZE];
+    double ys[RND_TILE_SIZE];
+
+    /* A parent tile fetched from the cache. */
+    uint16_t* parentiterations;
+    uint8_t* parentflags;
+    double* parentzx;
+    double* parentzy;
+
+    SIMD_BatchStats stats;
+    uint64_t iterated;
+    uint64_t reused;
+    uint64_t resumed;
+    uint64_t tiles;
+    uint64_t cachedtiles;
+    uint64_t filetiles;
+    uint64_t cardioidskips;
+    uint64_t cancelledtiles;
+    uint64_t reiterated;
+    uint64_t skippedsteps;
+    uint64_t rebases;
+} RND_Worker;
+
+static POOL_Pool* pool = NULL;
+static RND_Worker* workers = NULL;
+static int requested_threads = 0;
+static int periodicity = 1;
+static int strategy = RENDER_BRUTEFORCE;
+static int approximation = APPROX_SERIES;
+static int reuse = 1;
+static CACHE_Cache* cache = NULL;
+static PTB_Reference* reference = NULL;
+static PTB_Reference* secondary = NULL;
+static PTB_Series series;
+static PTB_Table* table = NULL;
+static DD_Base base;
+static size_t cachebudget = RND_CACHE_BUDGET;
+
+static SDL_atomic_t cancels;
+static int generation = -1;
+
+static RenderStats laststats;
+static RND_Frame frame;
+static RND_Frame previous;
+
+static void destroyWorkers( void )
+{
+    if ( pool )
+    {
+        int i;
+        for ( i = 0; i < POOL_GetThreadCount( pool ); i++ )
+        {
+            SIMD_DestroyBatch( workers[i].batch );
+            free( workers[i].iterations );
+            free( workers[i].zx );
+            free( workers[i].zy );
+            free( workers[i].known );
+            free( workers[i].cycled );
+            free( workers[i].rects );
+            free( workers[i].scan );
+            free( workers[i].flags );
+            free( workers[i].parentiterations );
+            free( workers[i].parentflags );
+            free( workers[i].parentzx );
+            free( workers[i].parentzy );
+        }
+        free( workers );
+        POOL_DestroyPool( pool );
+    }
+    pool = NULL;
+    workers = NULL;
+}
+
+/* Starts the pool and its scratch space the first time they are needed. */
+static int createWorkers( void )
+{
+    if ( pool )
+    {
+        return 1;
+    }
+
+    int threads = requested_threads;
+    if ( threads <= 0 )
+    {
+        threads = SDL_GetCPUCount( );
+    }
+
+    pool = POOL_CreatePool( threads );
+    if ( !pool )
+    {
+        return 0;
+    }
+
+    threads = POOL_GetThreadCount( pool );
+    workers = calloc( threads, sizeof(RND_Worker) );
+    if ( !workers )
+    {
+        POOL_DestroyPool( pool );
+        pool = NULL;
+        return 0;
+    }
+
+    int i;
+    for ( i = 0; i < threads; i++ )
+    {
+        workers[i].batch = SIMD_CreateBatch( RND_TILE_SIZE * RND_TILE_SIZE );
+        workers[i].iterations = malloc( RND_TILE_SIZE * RND_TILE_SIZE * sizeof(uint16_t) );
+        workers[i].zx = malloc( RND_TILE_SIZE * RND_TILE_SIZE * sizeof(double) );
+        workers[i].zy = malloc( RND_TILE_SIZE * RND_TILE_SIZE * sizeof(double) );
+        workers[i].known = malloc( RND_TILE_SIZE * RND_TILE_SIZE );
+        workers[i].cycled = malloc( RND_TILE_SIZE * RND_TILE_SIZE );
+        workers[i].rects = malloc( 2 * RND_MAX_RECTS * sizeof(RND_Rect) );
+        workers[i].scan = malloc( 2 * RND_TILE_SIZE * RND_TILE_SIZE * sizeof(uint16_t) );
+        workers[i].flags = malloc( RND_TILE_SIZE * RND_TILE_SIZE );
+        workers[i].parentiterations = malloc( RND_TILE_SIZE * RND_TILE_SIZE * sizeof(uint16_t) );
+        workers[i].parentflags = malloc( RND_TILE_SIZE * RND_TILE_SIZE );
+        workers[i].parentzx = malloc( RND_TILE_SIZE * RND_TILE_SIZE * sizeof(double) );
+        workers[i].parentzy = malloc( RND_TILE_SIZE * RND_TILE_SIZE * sizeof(double) );
+        if ( !workers[i].batch || !workers[i].iterations || !workers[i].zx || !workers[i].zy
+             || !workers[i].known || !workers[i].cycled || !workers[i].rects || !workers[i].scan
+             || !workers[i].flags
+             || !workers[i].parentiterations || !workers[i].parentflags
+             || !workers[i].parentzx || !workers[i].parentzy )
+        {
+            destroyWorkers( );
+            return 0;
+        }
+        workers[i].output.iter = workers[i].iterations;
+        workers[i].output.zx = workers[i].zx;
+        workers[i].output.zy = workers[i].zy;
+        workers[i].output.cycled = workers[i].cycled;
+    }
+
+    return 1;
+}
+
+static void freeFrame( RND_Frame* f )
+{
+    free( f->xs );
+    free( f->ys );
+    free( f->iterations );
+    free( f->smooth );
+    free( f->zx );
+    free( f->zy );
+    free( f->flags );
+    memset( f, 0, sizeof(RND_Frame) );
+}
+
+/* Sizes a retained frame for a w x h render. */
+static int resizeFrame( RND_Frame* f, uint16_t w, uint16_t h )
+{
+    if ( f->iterations && f->w == w && f->h == h )
+    {
+        return 1;
+    }
+
+    freeFrame( f );
+    size_t pixels = (size_t)w * h;
+    f->xs = malloc( w * sizeof(double) );
+    f->ys = malloc( h * sizeof(double) );
+    f->iterations = malloc( pixels * sizeof(uint16_t) );
+    f->smooth = malloc( pixels * sizeof(float) );
+    f->zx = malloc( pixels * sizeof(double) );
+    f->zy = malloc( pixels * sizeof(double) );
+    f->flags = malloc( pixels );
+    if ( !f->xs || !f->ys || !f->iterations || !f->smooth || !f->zx || !f->zy || !f->flags )
+    {
+        freeFrame( f );
+        return 0;
+    }
+
+    f->w = w;
+    f->h = h;
+    return 1;
+}
+
+/* Works out the smooth escape counts of a rectangle of the frame. Escaped
+   pixels with a final z get the usual fractional count; the rest keep
+   their escape count. */
+static void smoothRect( int x, int y, int w, int h )
+{
+    int i, j;
+    for ( j = y; j < y + h; j++ )
+    {
+        size_t row = (size_t)j * frame.w;
+        for ( i = x; i < x + w; i++ )
+        {
+            size_t n = row + i;
+            uint16_t iterations = frame.iterations[n];
+            frame.smooth[n] = iterations;
+            if ( (frame.flags[n] & RND_FRAME_HAVEZ) && iterations < frame.maxiter )
+            {
+                double mag2 = frame.zx[n] * frame.zx[n] + frame.zy[n] * frame.zy[n];
+                frame.smooth[n] = iterations + 1 - log2( 0.5 * log2( mag2 ) );
+            }
+        }
+    }
+}
+
+/* Colors a rectangle of the frame one row span at a time. */
+static void colorizeRect( void* buf, int pitch, const SpanColorizer* colorizer,
+                          int x, int y, int w, int h )
+{
+    int j;
+    for ( j = y; j < y + h; j++ )
+    {
+        size_t row = (size_t)j * frame.w + x;
+        const float* smooth = colorizer->smooth ? frame.smooth + row : NULL;
+        uint8_t* pix = (uint8_t*)buf + (size_t)j * pitch + x * colorizer->elsize;
+        (*colorizer->func)( frame.iterations + row, smooth, w, pix, colorizer->userdata );
+    }
+}
+
+/* The span function of an adapted PlotFunction, which only takes whole
+   counts, so smooth is never asked for. */
+static void plotSpan( const uint16_t* iterations, const float* smooth, int count,
+                      void* dst, void* userdata )
+{
+    const RND_PlotAdapter* adapter = userdata;
+    uint8_t* pix = dst;
+    (void)smooth;
+    int n;
+    for ( n = 0; n < count; n++ )
+    {
+        (*adapter->func)( iterations[n], pix );
+        pix += adapter->elsize;
+    }
+}
+
+void RND_AdaptPlotFunction( SpanColorizer* colorizer, RND_PlotAdapter* adapter,
+                            PlotFunction func, size_t elsize )
+{
+    adapter->func = func;
+    adapter->elsize = elsize;
+    colorizer->func = plotSpan;
+    colorizer->elsize = elsize;
+    colorizer->smooth = 0;
+    colorizer->userdata = adapter;
+}
+
+void SetRenderThreads( int threads )
+{
+    if ( threads != requested_threads )
+    {
+        requested_threads = threads;
+        destroyWorkers( );
+    }
+}
+
+void SetPeriodicityCheck( int enabled )
+{
+    periodicity = enabled;
+}
+
+int GetPeriodicityCheck( void )
+{
+    return periodicity;
+}
+
+void SetFrameReuse( int enabled )
+{
+    reuse = enabled;
+}
+
+int GetFrameReuse( void )
+{
+    return reuse;
+}
+
+void SetRenderStrategy( int which )
+{
+    if ( which >= 0 && which < RENDER_STRATEGIES )
+    {
+        strategy = which;
+    }
+}
+
+int GetRenderStrategy( void )
+{
+    return strategy;
+}
+
+void SetDeepApproximation( int which )
+{
+    if ( which >= 0 && which < APPROX_MODES )
+    {
+        approximation = which;
+    }
+}
+
+int GetDeepApproximation( void )
+{
+    return approximation;
+}
+
+void SetTileCacheBudget( size_t bytes )
+{
+    cachebudget = bytes;
+    if ( cache )
+    {
+        CACHE_SetBudget( cache, bytes );
+    }
+}
+
+int SetTileCacheFile( const char* path )
+{
+    if ( !cache )
+    {
+        if ( !path )
+        {
+            return 1;
+        }
+        cache = CACHE_CreateCache( RND_TILE_SIZE * RND_TILE_SIZE, cachebudget );
+        if ( !cache )
+        {
+            return 0;
+        }
+    }
+
+    if ( !path )
+    {
+        CACHE_DetachFile( cache );
+        return 1;
+    }
+    /* Everything besides the tile layout that decides what a tile's
+       counts mean. The struct is cleared first, so padding is zero. */
+    struct
+    {
+        uint32_t version;
+        uint32_t tilesize;
+        uint32_t havez;
+        uint32_t exact;
+        double cycletolerance;
+    } format;
+    memset( &format, 0, sizeof(format) );
+    format.version = RND_FORMAT_VERSION;
+    format.tilesize = RND_TILE_SIZE;
+    format.havez = RND_FRAME_HAVEZ;
+    format.exact = RND_FRAME_EXACT;
+    format.cycletolerance = RND_CYCLE_TOLERANCE;
+    return CACHE_AttachFile( cache, path, RND_CACHE_FILE_LIMIT, &format, sizeof(format) );
+}
+
+const float* RND_GetSmooth( void )
+{
+    if ( !frame.iterations )
+    {
+        return NULL;
+    }
+
+    if ( !frame.smoothready )
+    {
+        smoothRect( 0, 0, frame.w, frame.h );
+        frame.smoothready = 1;
+    }
+    return frame.smooth;
+}
+
+int RecolorSpans( void* buf, int pitch, uint16_t w, uint16_t h, const SpanColorizer* colorizer )
+{
+    if ( !frame.iterations || frame.w != w || frame.h != h )
+    {
+        return 0;
+    }
+
+    if ( colorizer->smooth )
+    {
+        RND_GetSmooth( );
+    }
+    colorizeRect( buf, pitch, colorizer, 0, 0, w, h );
+    return 1;
+}
+
+int RecolorF( void* buf, size_t elsize, int pitch, uint16_t w, uint16_t h, PlotFunction func )
+{
+    SpanColorizer colorizer;
+    RND_PlotAdapter adapter;
+    RND_AdaptPlotFunction( &colorizer, &adapter, func, elsize );
+    return RecolorSpans( buf, pitch, w, h, &colorizer );
+}
+
+void ShutdownRender( void )
+{
+    destroyWorkers( );
+    freeFrame( &frame );
+    freeFrame( &previous );
+    CACHE_DestroyCache( cache );
+    cache = NULL;
+    PTB_DestroyReference( reference );
+    reference = NULL;
+    PTB_DestroyReference( secondary );
+    secondary = NULL;
+    PTB_DestroyTable( table );
+    table = NULL;
+}
+
+void CancelRender( void )
+{
+    SDL_AtomicIncRef( &cancels );
+}
+
+int GetRenderGeneration( void )
+{
+    return SDL_AtomicGet( &cancels );
+}
+
+void SetRenderGeneration( int which )
+{
+    generation = which;
+}
+
+void GetRenderStats( RenderStats* stats )
+{
+    *stats = laststats;
+}
+
+/* Queues pixel (i, j) of the tile for the batch engine, unless it is
+   already known. Mandelbrot pixels inside the main cardioid or period-2
+   bulb are given maxiter on the spot, except in a perturbed or
+   double-double job, whose coordinates are offsets. */
+static inline void queuePixel( RND_Job* job, RND_Worker* scratch, const RND_Tile* tile, int i, int j )
+{
+    int n = i + j * tile->w;
+    if ( scratch->known[n] & RND_KNOWN )
+    {
+        return;
+    }
+    scratch->known[n] |= RND_KNOWN;
+
+    double x = tile->xs[i];
+    double y = tile->ys[j];
+    if ( job->perturb )
+    {
+        PTB_PushPixel( scratch->batch, &series, job->julia, x, y, n );
+        scratch->known[n] |= RND_ITERATED | RND_EXACT;
+        scratch->skippedsteps += series.skip;
+    }
+    else if ( job->doubledouble )
+    {
+        if ( job->julia )
+        {
+            SIMD_PushPixel( scratch->batch, x, y, 0, 0, 1, n );
+        }
+        else
+        {
+            SIMD_PushPixel( scratch->batch, 0, 0, x, y, 1, n );
+        }
+        scratch->known[n] |= RND_ITERATED | RND_EXACT;
+    }
+    else if ( job->julia )
+    {
+        SIMD_PushPixel( scratch->batch, x, y, job->cx, job->cy, 1, n );
+        scratch->known[n] |= RND_ITERATED | RND_EXACT;
+    }
+    else if ( MandelbrotInterior( x, y ) )
+    {
+        scratch->iterations[n] = job->maxiter;
+        scratch->known[n] |= RND_EXACT;
+        scratch->cardioidskips++;
+    }
+    else
+    {
+        SIMD_PushPixel( scratch->batch, 0, 0, x, y, 1, n );
+        scratch->known[n] |= RND_ITERATED | RND_EXACT;
+    }
+}
+
+/* The periodicity check's tolerance for the job, which scales with its
+   pixels, or 0 with the check off. */
+static double cycleTolerance( const RND_Job* job )
+{
+    return periodicity ? job->pixelsize * RND_CYCLE_TOLERANCE : 0;
+}
+
+static void runQueued( RND_Job* job, RND_Worker* scratch )
+{
+    double tolerance = cycleTolerance( job );
+    scratch->iterated += scratch->batch->count;
+    if ( job->perturb && job->approximation == APPROX_BLA )
+    {
+        PTB_RunBatchBLA( reference, table, scratch->batch, job->maxiter, 1, &scratch->output,
+                         &scratch->stats, &scratch->skippedsteps, &scratch->rebases );
+        return;
+    }
+    if ( job->perturb )
+    {
+        PTB_RunBatch( reference, scratch->batch, job->maxiter, 1, &scratch->output, &scratch->stats );
+        return;
+    }
+    if ( job->doubledouble )
+    {
+        DD_RunBatch( &base, scratch->batch, job->maxiter, tolerance, &scratch->output, &scratch->stats );
+        return;
+    }
+    SIMD_RunBatch( scratch->batch, job->maxiter, tolerance, &scratch->output, &scratch->stats );
+}
+
+static void bruteForceTile( RND_Job* job, RND_Worker* scratch, const RND_Tile* tile )
+{
+    int i, j;
+    for ( j = 0; j < tile->h; j++ )
+    {
+        for ( i = 0; i < tile->w; i++ )
+        {
+            queuePixel( job, scratch, tile, i, j );
+        }
+    }
+    runQueued( job, scratch );
+}
+
+/* When the rectangle's whole border shares one count, gives the pixels of
+   its interior not yet known that count and returns 1. Returns 0, leaving
+   the interior alone, when the border is not uniform or is glitched. */
+static int fillUniform( RND_Worker* scratch, const RND_Tile* tile, const RND_Rect* r )
+{
+    const uint16_t* it = scratch->iterations;
+    int w = tile->w;
+    uint16_t value = it[r->x0 + r->y0 * w];
+    if ( value == 0 )
+    {
+        return 0;
+    }
+
+    int i, j;
+    for ( i = r->x0; i <= r->x1; i++ )
+    {
+        if ( it[i + r->y0 * w] != value || it[i + r->y1 * w] != value )
+        {
+            return 0;
+        }
+    }
+    for ( j = r->y0; j <= r->y1; j++ )
+    {
+        if ( it[r->x0 + j * w] != value || it[r->x1 + j * w] != value )
+        {
+            return 0;
+        }
+    }
+
+    for ( j = r->y0 + 1; j < r->y1; j++ )
+    {
+        for ( i = r->x0 + 1; i < r->x1; i++ )
+        {
+            if ( !(scratch->known[i + j * w] & RND_KNOWN) )
+            {
+                scratch->known[i + j * w] |= RND_KNOWN;
+                scratch->iterations[i + j * w] = value;
+            }
+        }
+    }
+    return 1;
+}
+
+/* Mariani-Silver subdivision. Rectangles are handled a generation at a
+   time, so that the borders of a whole generation go through the batch
+   engine together. */
+static void subdivideTile( RND_Job* job, RND_Worker* scratch, const RND_Tile* tile )
+{
+    RND_Rect* rects = scratch->rects;
+    RND_Rect* next = scratch->rects + RND_MAX_RECTS;
+    int count = 1;
+    rects[0].x0 = 0;
+    rects[0].y0 = 0;
+    rects[0].x1 = tile->w - 1;
+    rects[0].y1 = tile->h - 1;
+
+    int i, j, k;
+    while ( count > 0 )
+    {
+        for ( k = 0; k < count; k++ )
+        {
+            const RND_Rect* r = &rects[k];
+            for ( i = r->x0; i <= r->x1; i++ )
+            {
+                queuePixel( job, scratch, tile, i, r->y0 );
+                queuePixel( job, scratch, tile, i, r->y1 );
+            }
+            for ( j = r->y0 + 1; j < r->y1; j++ )
+            {
+                queuePixel( job, scratch, tile, r->x0, j );
+                queuePixel( job, scratch, tile, r->x1, j );
+            }
+        }
+        runQueued( job, scratch );
+
+        int nextcount = 0;
+        for ( k = 0; k < count; k++ )
+        {
+            RND_Rect r = rects[k];
+            if ( r.x1 - r.x0 < 2 || r.y1 - r.y0 < 2 || fillUniform( scratch, tile, &r ) )
+            {
+                continue;
+            }
+
+            if ( r.x1 - r.x0 <= RND_MIN_SUBDIVIDE || r.y1 - r.y0 <= RND_MIN_SUBDIVIDE )
+            {
+                /* Iterated with the next generation's borders. */
+                for ( j = r.y0 + 1; j < r.y1; j++ )
+                {
+                    for ( i = r.x0 + 1; i < r.x1; i++ )
+                    {
+                        queuePixel( job, scratch, tile, i, j );
+                    }
+                }
+                continue;
+            }
+
+            int mx = (r.x0 + r.x1) / 2;
+            int my = (r.y0 + r.y1) / 2;
+            RND_Rect* child = &next[nextcount];
+            child[0] = (RND_Rect){ r.x0, r.y0, mx, my };
+            child[1] = (RND_Rect){ mx, r.y0, r.x1, my };
+            child[2] = (RND_Rect){ r.x0, my, mx, r.y1 };
+            child[3] = (RND_Rect){ mx, my, r.x1, r.y1 };
+            nextcount += 4;
+        }
+
+        RND_Rect* swap = rects;
+        rects = next;
+        next = swap;
+        count = nextcount;
+    }
+    runQueued( job, scratch );
+}
+
+static inline void tracePixel( RND_Worker* scratch, uint16_t* list, int* count, int n )
+{
+    if ( !(scratch->known[n] & RND_TRACED) )
+    {
+        scratch->known[n] |= RND_TRACED;
+        list[(*count)++] = n;
+    }
+}
+
+/* Boundary tracing. Every pixel on the scan list is compared with its
+   neighbours, and where they differ the neighbours join the next scan
+   list, so the scan spreads along the edges between regions of equal count
+   and never enters their interiors. A glitched pixel differs from all its
+   neighbours, so the scan covers a glitched patch whole. Like
+   subdivision, a whole scan list goes through the batch engine at once.
+   The interiors are then filled row by row from the left, since each is
+   enclosed by pixels of its count. */
+static void boundaryTraceTile( RND_Job* job, RND_Worker* scratch, const RND_Tile* tile )
+{
+    uint16_t* list = scratch->scan;
+    uint16_t* next = scratch->scan + RND_TILE_SIZE * RND_TILE_SIZE;
+    int w = tile->w;
+    int h = tile->h;
+    int count = 0;
+
+    int i, j, k;
+    for ( i = 0; i < w; i++ )
+    {
+        tracePixel( scratch, list, &count, i );
+        tracePixel( scratch, list, &count, i + (h - 1) * w );
+    }
+    for ( j = 1; j < h - 1; j++ )
+    {
+        tracePixel( scratch, list, &count, j * w );
+        tracePixel( scratch, list, &count, w - 1 + j * w );
+    }
+
+    while ( count > 0 )
+    {
+        for ( k = 0; k < count; k++ )
+        {
+            i = list[k] % w;
+            j = list[k] / w;
+            queuePixel( job, scratch, tile, i, j );
+            if ( i > 0 ) queuePixel( job, scratch, tile, i - 1, j );
+            if ( i < w - 1 ) queuePixel( job, scratch, tile, i + 1, j );
+            if ( j > 0 ) queuePixel( job, scratch, tile, i, j - 1 );
+            if ( j < h - 1 ) queuePixel( job, scratch, tile, i, j + 1 );
+        }
+        runQueued( job, scratch );
+
+        int nextcount = 0;
+        const uint16_t* it = scratch->iterations;
+        for ( k = 0; k < count; k++ )
+        {
+            int n = list[k];
+            i = n % w;
+            j = n / w;
+            uint16_t center = it[n];
+            int glitched = center == 0;
+
+            int l = i > 0 && (glitched || it[n - 1] != center);
+            int r = i < w - 1 && (glitched || it[n + 1] != center);
+            int u = j > 0 && (glitched || it[n - w] != center);
+            int d = j < h - 1 && (glitched || it[n + w] != center);
+
+            if ( l ) tracePixel( scratch, next, &nextcount, n - 1 );
+            if ( r ) tracePixel( scratch, next, &nextcount, n + 1 );
+            if ( u ) tracePixel( scratch, next, &nextcount, n - w );
+            if ( d ) tracePixel( scratch, next, &nextcount, n + w );
+
+            /* Diagonal neighbours keep the trace connected around corners. */
+            if ( i > 0 && j > 0 && (l || u) ) tracePixel( scratch, next, &nextcount, n - w - 1 );
+            if ( i < w - 1 && j > 0 && (r || u) ) tracePixel( scratch, next, &nextcount, n - w + 1 );
+            if ( i > 0 && j < h - 1 && (l || d) ) tracePixel( scratch, next, &nextcount, n + w - 1 );
+            if ( i < w - 1 && j < h - 1 && (r || d) ) tracePixel( scratch, next, &nextcount, n + w + 1 );
+        }
+
+        uint16_t* swap = list;
+        list = next;
+        next = swap;
+        count = nextcount;
+    }
+
+    for ( j = 0; j < h; j++ )
+    {
+        for ( i = 1; i < w; i++ )
+        {
+            int n = i + j * w;
+            if ( !(scratch->known[n] & RND_KNOWN) )
+            {
+                scratch->known[n] |= RND_KNOWN;
+                scratch->iterations[n] = scratch->iterations[n - 1];
+            }
+        }
+    }
+}
+
+/* Tells whether a count of an exact pixel, worked out with the cycle
+   tolerance from, holds at the tolerance to. Escape counts hold at any
+   tolerance, and so do counts run out to maxiter with a final z, but a
+   count of maxiter without one may have come from the periodicity check,
+   which only a tolerance at least as loose is sure to repeat. */
+static inline int countHolds( uint16_t count, uint8_t flags, uint16_t maxiter, double from,
+                              double to )
+{
+    return from <= to || count < maxiter || (flags & RND_FRAME_HAVEZ);
+}
+
+/* Carries on with pixel (i, j) of the tile from where the previous frame,
+   pixel m, stopped it at its lower maxiter. Pixels with a final z are
+   queued to continue from it; the rest were found inside the cardioid or
+   bulb, or to be periodic, and get the new maxiter. */
+static void resumePixel( RND_Job* job, RND_Worker* scratch, const RND_Tile* tile,
+                         int i, int j, size_t m )
+{
+    int n = i + j * tile->w;
+    scratch->known[n] = RND_KNOWN | RND_EXACT;
+    if ( previous.flags[m] & RND_FRAME_HAVEZ )
+    {
+        double cx = job->julia ? job->cx : tile->xs[i];
+        double cy = job->julia ? job->cy : tile->ys[j];
+        SIMD_PushPixel( scratch->batch, previous.zx[m], previous.zy[m], cx, cy,
+                        previous.iterations[m], n );
+        scratch->known[n] |= RND_ITERATED;
+        scratch->resumed++;
+    }
+    else
+    {
+        scratch->iterations[n] = job->maxiter;
+        scratch->reused++;
+    }
+}
+
+/* Copies the counts of the tile's pixels that sit exactly on a computed
+   pixel of the previous frame, and marks them known, unless they already
+   are. When the previous frame had a lower maxiter, the pixels it stopped
+   are resumed instead. */
+static void reuseTile( RND_Job* job, RND_Worker* scratch, const RND_Tile* tile )
+{
+    double tolerance = cycleTolerance( job );
+    int i, j;
+    for ( j = 0; j < tile->h; j++ )
+    {
+        int y = tile->y + j;
+        int row = y >= 0 && y < job->h ? job->reuserows[y] : -1;
+        if ( row < 0 )
+        {
+            continue;
+        }
+
+        for ( i = 0; i < tile->w; i++ )
+        {
+            int x = tile->x + i;
+            int col = x >= 0 && x < job->w ? job->reusecols[x] : -1;
+            if ( col < 0 )
+            {
+                continue;
+            }
+
+            size_t m = (size_t)row * previous.w + col;
+            if ( !(previous.flags[m] & RND_FRAME_EXACT)
+                 || !countHolds( previous.iterations[m], previous.flags[m], previous.maxiter,
+                                 previous.cycletolerance, tolerance ) )
+            {
+                continue;
+            }
+
+            int n = i + j * tile->w;
+            if ( scratch->known[n] & RND_KNOWN )
+            {
+                continue;
+            }
+            if ( previous.iterations[m] >= previous.maxiter && previous.maxiter < job->maxiter )
+            {
+                resumePixel( job, scratch, tile, i, j, m );
+                continue;
+            }
+
+            scratch->known[n] = RND_KNOWN | RND_EXACT;
+            scratch->iterations[n] = previous.iterations[m];
+            if ( previous.flags[m] & RND_FRAME_HAVEZ )
+            {
+                scratch->known[n] |= RND_ITERATED;
+                scratch->zx[n] = previous.zx[m];
+                scratch->zy[n] = previous.zy[m];
+            }
+            scratch->reused++;
+        }
+    }
+}
+
+static inline int64_t floorDiv( int64_t n, int64_t d )
+{
+    return n >= 0 ? n / d : -((-n + d - 1) / d);
+}
+
+/* Places tile task of the job, either on the frame or on the view's grid. */
+static void placeTile( RND_Job* job, RND_Worker* scratch, int task, RND_Tile* tile )
+{
+    int col = task % job->tilesx;
+    int row = task / job->tilesx;
+
+    if ( job->view )
+    {
+        const FractalView* view = job->view;
+        tile->tx = job->tx0 + col;
+        tile->ty = job->ty0 + row;
+        tile->x = (int)(tile->tx * RND_TILE_SIZE - view->x);
+        tile->y = (int)(tile->ty * RND_TILE_SIZE - view->y);
+        tile->w = RND_TILE_SIZE;
+        tile->h = RND_TILE_SIZE;
+
+        int i;
+        for ( i = 0; i < RND_TILE_SIZE; i++ )
+        {
+            scratch->xs[i] = RND_GridPoint( view->re, view->dre, view->level,
+                                            tile->tx * RND_TILE_SIZE + i );
+            scratch->ys[i] = RND_GridPoint( view->im, view->dim, view->level,
+                                            tile->ty * RND_TILE_SIZE + i );
+        }
+        tile->xs = scratch->xs;
+        tile->ys = scratch->ys;
+    }
+    else
+    {
+        tile->tx = col;
+        tile->ty = row;
+        tile->x = col * RND_TILE_SIZE;
+        tile->y = row * RND_TILE_SIZE;
+        tile->w = job->w - tile->x < RND_TILE_SIZE ? job->w - tile->x : RND_TILE_SIZE;
+        tile->h = job->h - tile->y < RND_TILE_SIZE ? job->h - tile->y : RND_TILE_SIZE;
+        tile->xs = job->xs + tile->x;
+        tile->ys = job->ys + tile->y;
+    }
+}
+
+static void tileKey( RND_Job* job, const RND_Tile* tile, CACHE_Key* key )
+{
+    memset( key, 0, sizeof(CACHE_Key) );
+    key->settings = job->strategy | periodicity << 4;
+    key->julia = job->julia;
+    if ( job->julia )
+    {
+        key->cx = job->cx;
+        key->cy = job->cy;
+    }
+    key->re = job->view->re;
+    key->im = job->view->im;
+    key->dre = job->view->dre;
+    key->dim = job->view->dim;
+    key->maxiter = job->maxiter;
+    key->level = job->view->level;
+    key->tx = tile->tx;
+    key->ty = tile->ty;
+}
+
+/* Copies the even pixels of the tile from the matching quarter of its
+   parent tile, if the parent is cached. The parent's pixels are twice the
+   size, and so is its cycle tolerance. */
+static void seedFromParent( RND_Job* job, RND_Worker* scratch, const CACHE_Key* key )
+{
+    double tolerance = cycleTolerance( job );
+    CACHE_Key parent = *key;
+    parent.level--;
+    parent.tx = floorDiv( key->tx, 2 );
+    parent.ty = floorDiv( key->ty, 2 );
+    if ( !CACHE_Lookup( cache, &parent, scratch->parentiterations, scratch->parentflags,
+                        scratch->parentzx, scratch->parentzy ) )
+    {
+        return;
+    }
+
+    int half = RND_TILE_SIZE / 2;
+    int qx = (int)(key->tx - 2 * parent.tx) * half;
+    int qy = (int)(key->ty - 2 * parent.ty) * half;
+
+    int i, j;
+    for ( j = 0; j < half; j++ )
+    {
+        for ( i = 0; i < half; i++ )
+        {
+            int m = (qx + i) + (qy + j) * RND_TILE_SIZE;
+            int n = 2 * i + 2 * j * RND_TILE_SIZE;
+            if ( !(scratch->parentflags[m] & RND_FRAME_EXACT) || (scratch->known[n] & RND_KNOWN)
+                 || !countHolds( scratch->parentiterations[m], scratch->parentflags[m],
+                                 key->maxiter, 2 * tolerance, tolerance ) )
+            {
+                continue;
+            }
+
+            scratch->known[n] = RND_KNOWN | RND_EXACT;
+            scratch->iterations[n] = scratch->parentiterations[m];
+            if ( scratch->parentflags[m] & RND_FRAME_HAVEZ )
+            {
+                scratch->known[n] |= RND_ITERATED;
+                scratch->zx[n] = scratch->parentzx[m];
+                scratch->zy[n] = scratch->parentzy[m];
+            }
+            scratch->reused++;
+        }
+    }
+}
+
+static void renderTile( int task, int worker, void* data )
+{
+    RND_Job* job = data;
+    RND_Worker* scratch = &workers[worker];
+
+    RND_Tile tile;
+    placeTile( job, scratch, task, &tile );
+    int pixels = tile.w * tile.h;
+
+    /* The part of the tile inside the frame. */
+    int i0 = tile.x < 0 ? -tile.x : 0;
+    int j0 = tile.y < 0 ? -tile.y : 0;
+    int i1 = job->w - tile.x < tile.w ? job->w - tile.x : tile.w;
+    int j1 = job->h - tile.y < tile.h ? job->h - tile.y : tile.h;
+
+    int i, j;
+    if ( SDL_AtomicGet( &cancels ) != job->cancel )
+    {
+        for ( j = j0; j < j1; j++ )
+        {
+            memset( frame.flags + (size_t)(tile.y + j) * frame.w + tile.x + i0, 0, i1 - i0 );
+        }
+        scratch->cancelledtiles++;
+        return;
+    }
+    scratch->tiles++;
+
+    CACHE_Key key;
+    int cached = job->view && cache;
+    if ( cached )
+    {
+        tileKey( job, &tile, &key );
+    }
+
+    int n;
+    int found = CACHE_MISS;
+    if ( cached )
+    {
+        found = CACHE_Lookup( cache, &key, scratch->iterations, scratch->flags,
+                              scratch->zx, scratch->zy );
+    }
+
+    if ( found != CACHE_MISS )
+    {
+        scratch->cachedtiles++;
+        if ( found == CACHE_FILE )
+        {
+            scratch->filetiles++;
+        }
+    }
+    else
+    {
+        /* The parent tile goes first: it holds the new maxiter's counts,
+           where the previous frame may only hold a lower one's. */
+        memset( scratch->known, 0, pixels );
+        memset( scratch->cycled, 0, pixels );
+        if ( cached )
+        {
+            seedFromParent( job, scratch, &key );
+        }
+        if ( job->reusecols )
+        {
+            reuseTile( job, scratch, &tile );
+        }
+
+        if ( job->strategy == RENDER_SUBDIVIDE )
+        {
+            subdivideTile( job, scratch, &tile );
+        }
+        else if ( job->strategy == RENDER_BOUNDARY )
+        {
+            boundaryTraceTile( job, scratch, &tile );
+        }
+        else
+        {
+            bruteForceTile( job, scratch, &tile );
+        }
+
+        for ( n = 0; n < pixels; n++ )
+        {
+            scratch->flags[n] = 0;
+            if ( scratch->known[n] & RND_EXACT )
+            {
+                scratch->flags[n] |= RND_FRAME_EXACT;
+            }
+            if ( (scratch->known[n] & RND_ITERATED) && !scratch->cycled[n] )
+            {
+                scratch->flags[n] |= RND_FRAME_HAVEZ;
+            }
+            else
+            {
+                scratch->zx[n] = 0;
+                scratch->zy[n] = 0;
+            }
+        }
+
+        if ( cached )
+        {
+            CACHE_Insert( cache, &key, scratch->iterations, scratch->flags, scratch->zx, scratch->zy );
+        }
+    }
+
+    /* Keep the part of the tile inside the frame. */
+    for ( j = j0; j < j1; j++ )
+    {
+        size_t row = (size_t)(tile.y + j) * frame.w + tile.x;
+        for ( i = i0; i < i1; i++ )
+        {
+            n = i + j * tile.w;
+            frame.iterations[row + i] = scratch->iterations[n];
+            frame.flags[row + i] = scratch->flags[n];
+            if ( scratch->flags[n] & RND_FRAME_HAVEZ )
+            {
+                frame.zx[row + i] = scratch->zx[n];
+                frame.zy[row + i] = scratch->zy[n];
+            }
+        }
+    }
+
+    if ( job->colorizer.smooth )
+    {
+        smoothRect( tile.x + i0, tile.y + j0, i1 - i0, j1 - j0 );
+    }
+    colorizeRect( job->buf, job->pitch, &job->colorizer, tile.x + i0, tile.y + j0, i1 - i0, j1 - j0 );
+}
+
+/* The glitched pixels of a perturbed frame being iterated again off a
+   secondary reference at offset (offx, offy) from the first. */
+typedef struct
+{
+    RND_Job* job;
+    const PTB_Reference* reference;
+    double offx, offy;
+    int glitches;
+    const uint32_t* pixels;
+    int count;
+} RND_GlitchJob;
+
+/* Iterates one batch worth of glitched pixels again. */
+static void reiterateGlitches( int task, int worker, void* data )
+{
+    RND_GlitchJob* glitch = data;
+    RND_Worker* scratch = &workers[worker];
+    int first = task * RND_TILE_SIZE * RND_TILE_SIZE;
+    int count = glitch->count - first;
+    if ( count > RND_TILE_SIZE * RND_TILE_SIZE )
+    {
+        count = RND_TILE_SIZE * RND_TILE_SIZE;
+    }
+
+    int n;
+    for ( n = 0; n < count; n++ )
+    {
+        uint32_t m = glitch->pixels[first + n];
+        double x = frame.xs[m % frame.w] - glitch->offx;
+        double y = frame.ys[m / frame.w] - glitch->offy;
+        PTB_PushPixel( scratch->batch, NULL, glitch->job->julia, x, y, n );
+    }
+    PTB_RunBatch( glitch->reference, scratch->batch, glitch->job->maxiter, glitch->glitches,
+                  &scratch->output, &scratch->stats );
+    scratch->reiterated += count;
+
+    for ( n = 0; n < count; n++ )
+    {
+        uint32_t m = glitch->pixels[first + n];
+        frame.iterations[m] = scratch->iterations[n];
+        frame.zx[m] = scratch->zx[n];
+        frame.zy[m] = scratch->zy[n];
+        frame.flags[m] = RND_FRAME_EXACT | RND_FRAME_HAVEZ;
+    }
+}
+
+/* Finds the largest 4-connected patch of the count glitched pixels, using
+   labels, a frame-sized scratch buffer, and returns the one of them
+   nearest the patch's centroid. */
+static uint32_t pickGlitchReference( const uint32_t* pixels, int count, int32_t* labels,
+                                     uint32_t* stack )
+{
+    size_t size = (size_t)frame.w * frame.h;
+    size_t m;
+    int n;
+    for ( m = 0; m < size; m++ )
+    {
+        labels[m] = -1;
+    }
+    for ( n = 0; n < count; n++ )
+    {
+        labels[pixels[n]] = 0;
+    }
+
+    int32_t label = 0;
+    int32_t best = 0;
+    int bestsize = 0;
+    double bestx = 0;
+    double besty = 0;
+    for ( n = 0; n < count; n++ )
+    {
+        if ( labels[pixels[n]] )
+        {
+            continue;
+        }
+
+        label++;
+        labels[pixels[n]] = label;
+        stack[0] = pixels[n];
+        int top = 1;
+        int patch = 0;
+        double sumx = 0;
+        double sumy = 0;
+        while ( top )
+        {
+            uint32_t p = stack[--top];
+            int i = p % frame.w;
+            int j = p / frame.w;
+            patch++;
+            sumx += i;
+            sumy += j;
+
+            uint32_t neighbours[4];
+            int k = 0;
+            if ( i > 0 )
+            {
+                neighbours[k++] = p - 1;
+            }
+            if ( i + 1 < frame.w )
+            {
+                neighbours[k++] = p + 1;
+            }
+            if ( j > 0 )
+            {
+                neighbours[k++] = p - frame.w;
+            }
+            if ( j + 1 < frame.h )
+            {
+                neighbours[k++] = p + frame.w;
+            }
+            while ( k-- )
+            {
+                if ( labels[neighbours[k]] == 0 )
+                {
+                    labels[neighbours[k]] = label;
+                    stack[top++] = neighbours[k];
+                }
+            }
+        }
+
+        if ( patch > bestsize )
+        {
+            best = label;
+            bestsize = patch;
+            bestx = sumx / patch;
+            besty = sumy / patch;
+        }
+    }
+
+    uint32_t chosen = pixels[0];
+    double nearest = -1;
+    for ( n = 0; n < count; n++ )
+    {
+        if ( labels[pixels[n]] == best )
+        {
+            double di = (double)(pixels[n] % frame.w) - bestx;
+            double dj = (double)(pixels[n] / frame.w) - besty;
+            if ( nearest < 0 || di * di + dj * dj < nearest )
+            {
+                chosen = pixels[n];
+                nearest = di * di + dj * dj;
+            }
+        }
+    }
+    return chosen;
+}
+
+/* Whether the render of the job, given as userdata, was cancelled. */
+static int renderCancelled( void* userdata )
+{
+    const RND_Job* job = userdata;
+    return SDL_AtomicGet( &cancels ) != job->cancel;
+}
+
+/* Iterates the glitched pixels of a perturbed frame again off secondary
+   references until none are left, and recolors the frame if any were.
+   Returns the number of references used, counting the first. */
+static int fixGlitches( RND_Job* job )
+{
+    size_t size = (size_t)frame.w * frame.h;
+    uint32_t* pixels = malloc( size * sizeof(uint32_t) );
+    uint32_t* stack = malloc( size * sizeof(uint32_t) );
+    int32_t* labels = malloc( size * sizeof(int32_t) );
+    int references = 1;
+
+    while ( pixels && stack && labels && SDL_AtomicGet( &cancels ) == job->cancel )
+    {
+        int count = 0;
+        size_t m;
+        for ( m = 0; m < size; m++ )
+        {
+            if ( frame.iterations[m] == 0 )
+            {
+                pixels[count++] = (uint32_t)m;
+            }
+        }
+        if ( !count )
+        {
+            break;
+        }
+
+        RND_GlitchJob glitch;
+        uint32_t chosen = pickGlitchReference( pixels, count, labels, stack );
+        glitch.job = job;
+        glitch.offx = frame.xs[chosen % frame.w];
+        glitch.offy = frame.ys[chosen / frame.w];
+        glitch.pixels = pixels;
+        glitch.count = count;
+
+        /* The last reference allowed gives every pixel left a count. */
+        references++;
+        glitch.glitches = references < PTB_MAX_REFERENCES;
+
+        BIG_Number re, im, offset;
+        BIG_FromDouble( &offset, glitch.offx );
+        BIG_Add( &re, &job->refre, &offset );
+        BIG_FromDouble( &offset, glitch.offy );
+        BIG_Add( &im, &job->refim, &offset );
+        if ( !secondary )
+        {
+            secondary = PTB_CreateReference( );
+        }
+        if ( secondary && PTB_ComputeReference( secondary, job->julia, &re, &im, &job->cre,
+                                                &job->cim, job->maxiter, job->limbs,
+                                                renderCancelled, job ) )
+        {
+            glitch.reference = secondary;
+        }
+        else if ( renderCancelled( job ) )
+        {
+            break;
+        }
+        else
+        {
+            glitch.reference = reference;
+            glitch.offx = 0;
+            glitch.offy = 0;
+            glitch.glitches = 0;
+        }
+
+        int batches = (count + RND_TILE_SIZE * RND_TILE_SIZE - 1) / (RND_TILE_SIZE * RND_TILE_SIZE);
+        POOL_Run( pool, batches, reiterateGlitches, &glitch );
+        if ( !glitch.glitches )
+        {
+            break;
+        }
+    }
+
+    free( pixels );
+    free( stack );
+    free( labels );
+
+    if ( references > 1 )
+    {
+        if ( job->colorizer.smooth )
+        {
+            smoothRect( 0, 0, frame.w, frame.h );
+        }
+        colorizeRect( job->buf, job->pitch, &job->colorizer, 0, 0, frame.w, frame.h );
+    }
+    return references;
+}
+
+/* Maps each of count coordinates in to the index of the same coordinate
+   in from, or to -1. Both axes must run in the same direction. Returns
+   the number of coordinates matched. */
+static int matchAxis( const double* from, int fromcount, const double* to, int count, int* map )
+{
+    int ascending = count < 2 || to[count - 1] > to[0];
+    int fromascending = fromcount < 2 || from[fromcount - 1] > from[0];
+    int matched = 0;
+    int i, k = 0;
+    for ( i = 0; i < count; i++ )
+    {
+        map[i] = -1;
+        if ( ascending != fromascending )
+        {
+            continue;
+        }
+        while ( k < fromcount && (ascending ? from[k] < to[i] : from[k] > to[i]) )
+        {
+            k++;
+        }
+        if ( k < fromcount && from[k] == to[i] )
+        {
+            map[i] = k;
+            matched++;
+        }
+    }
+    return matched;
+}
+
+/* Moves the count coordinates in to onto the nearest of the fromcount in
+   from that lies within tolerance and has not been used yet. */
+static void snapAxis( const double* from, int fromcount, double* to, int count, double tolerance )
+{
+    if ( fromcount < 1 || count < 1 )
+    {
+        return;
+    }
+
+    int ascending = count < 2 || to[count - 1] > to[0];
+    int fromascending = fromcount < 2 || from[fromcount - 1] > from[0];
+    if ( ascending != fromascending )
+    {
+        return;
+    }
+
+    /* Walk both axes as if ascending. */
+    double sign = ascending ? 1 : -1;
+    int used = -1;
+    int i, k = 0;
+    for ( i = 0; i < count; i++ )
+    {
+        double t = sign * to[i];
+        while ( k + 1 < fromcount && sign * from[k + 1] <= t )
+        {
+            k++;
+        }
+
+        int best = -1;
+        double distance = tolerance;
+        int n;
+        for ( n = k; n <= k + 1 && n < fromcount; n++ )
+        {
+            double d = fabs( sign * from[n] - t );
+            if ( n > used && d <= distance )
+            {
+                best = n;
+                distance = d;
+            }
+        }
+
+        if ( best >= 0 )
+        {
+            to[i] = from[best];
+            used = best;
+        }
+    }
+}
+
+void RND_SnapToFrame( double* xs, int w, double* ys, int h, double xtolerance, double ytolerance )
+{
+    /* The frame RND_Render will make the previous one. */
+    const RND_Frame* source = frame.transient ? &previous : &frame;
+    if ( !source->iterations || source->relative )
+    {
+        return;
+    }
+
+    snapAxis( source->xs, source->w, xs, w, xtolerance );
+    snapAxis( source->ys, source->h, ys, h, ytolerance );
+}
+
+/* Points the job at the previous frame's matching columns and rows, if it
+   plotted the same fractal with the same maxiter. Returns the maps, which
+   the caller frees, or NULL when nothing can be reused. */
+static int* matchPrevious( RND_Job* job )
+{
+    job->reusecols = NULL;
+    job->reuserows = NULL;
+    if ( !reuse || !previous.iterations || job->perturb || job->doubledouble || previous.relative
+         || previous.julia != job->julia
+         || previous.maxiter > job->maxiter
+         || (job->julia && (previous.cx != job->cx || previous.cy != job->cy)) )
+    {
+        return NULL;
+    }
+
+    int* maps = malloc( ((size_t)job->w + job->h) * sizeof(int) );
+    if ( !maps )
+    {
+        return NULL;
+    }
+
+    if ( !matchAxis( previous.xs, previous.w, job->xs, job->w, maps )
+         || !matchAxis( previous.ys, previous.h, job->ys, job->h, maps + job->w ) )
+    {
+        free( maps );
+        return NULL;
+    }
+
+    job->reusecols = maps;
+    job->reuserows = maps + job->w;
+    return maps;
+}
+
+int RND_Render( RND_Job* job )
+{
+    /* Taken first, so that a cancel while the reference orbit and its
+       tables are worked out stops this render too. */
+    job->cancel = generation >= 0 ? generation : SDL_AtomicGet( &cancels );
+
+    /* The last frame becomes the previous one, and the new frame is
+       rendered over the one before it. A preview or cancelled frame is
+       rendered over instead, so that the render after it reuses the frame
+       before it. The frames only trade places once nothing can fail, so
+       that a render out of memory keeps the last one. */
+    RND_Frame* target = frame.transient ? &frame : &previous;
+    if ( !createWorkers( ) || !resizeFrame( target, job->w, job->h ) )
+    {
+        return 0;
+    }
+    if ( target == &previous )
+    {
+        RND_Frame swap = previous;
+        previous = frame;
+        frame = swap;
+    }
+    if ( job->perturb )
+    {
+        if ( !reference )
+        {
+            reference = PTB_CreateReference( );
+        }
+        if ( !reference || !PTB_ComputeReference( reference, job->julia, &job->refre, &job->refim,
+                                                  &job->cre, &job->cim, job->maxiter, job->limbs,
+                                                  renderCancelled, job ) )
+        {
+            frame.transient = 1;
+            return renderCancelled( job );
+        }
+
+        /* Probe a grid over the frame, edges included. */
+        double probex[PTB_SERIES_PROBES], probey[PTB_SERIES_PROBES];
+        int probes = 0;
+        int pi, pj;
+        for ( pj = 0; pj < RND_SERIES_GRID; pj++ )
+        {
+            for ( pi = 0; pi < RND_SERIES_GRID; pi++ )
+            {
+                probex[probes] = job->xs[pi * (job->w - 1) / (RND_SERIES_GRID - 1)];
+                probey[probes] = job->ys[pj * (job->h - 1) / (RND_SERIES_GRID - 1)];
+                probes++;
+            }
+        }
+        memset( &series, 0, sizeof(PTB_Series) );
+        if ( approximation == APPROX_BLA )
+        {
+            /* The probes take in the corners, the furthest pixels out. */
+            double radius = 0;
+            int n;
+            for ( n = 0; n < probes; n++ )
+            {
+                double r = hypot( probex[n], probey[n] );
+                radius = r > radius ? r : radius;
+            }
+            if ( !table )
+            {
+                table = PTB_CreateTable( );
+            }
+            if ( !table || !PTB_BuildTable( table, reference, radius, renderCancelled, job ) )
+            {
+                frame.transient = 1;
+                return renderCancelled( job );
+            }
+        }
+        else
+        {
+            PTB_ComputeSeries( &series, reference, probex, probey, probes, job->pixelsize,
+                               job->maxiter );
+        }
+    }
+    if ( job->doubledouble )
+    {
+        /* Julia pixels are offsets in z, Mandelbrot pixels in c. */
+        if ( job->julia )
+        {
+            DD_FromBig( &base.zx, &job->refre );
+            DD_FromBig( &base.zy, &job->refim );
+            DD_FromBig( &base.cx, &job->cre );
+            DD_FromBig( &base.cy, &job->cim );
+        }
+        else
+        {
+            memset( &base, 0, sizeof(DD_Base) );
+            DD_FromBig( &base.cx, &job->refre );
+            DD_FromBig( &base.cy, &job->refim );
+        }
+    }
+    frame.julia = job->julia;
+    frame.cx = job->cx;
+    frame.cy = job->cy;
+    frame.maxiter = job->maxiter;
+    frame.cycletolerance = cycleTolerance( job );
+    frame.transient = job->view && job->view->preview;
+    frame.relative = job->perturb || job->doubledouble;
+    frame.smoothready = 0;
+    memcpy( frame.xs, job->xs, job->w * sizeof(double) );
+    memcpy( frame.ys, job->ys, job->h * sizeof(double) );
+
+    int threads = POOL_GetThreadCount( pool );
+    int i;
+    for ( i = 0; i < threads; i++ )
+    {
+        workers[i].stats.lanesteps = 0;
+        workers[i].stats.activesteps = 0;
+        workers[i].stats.cycles = 0;
+        workers[i].iterated = 0;
+        workers[i].reused = 0;
+        workers[i].resumed = 0;
+        workers[i].tiles = 0;
+        workers[i].cachedtiles = 0;
+        workers[i].filetiles = 0;
+        workers[i].cardioidskips = 0;
+        workers[i].cancelledtiles = 0;
+        workers[i].reiterated = 0;
+        workers[i].skippedsteps = 0;
+        workers[i].rebases = 0;
+    }
+
+    job->strategy = strategy;
+    job->approximation = approximation;
+    int* maps = matchPrevious( job );
+
+    if ( job->view )
+    {
+        job->tx0 = floorDiv( job->view->x, RND_TILE_SIZE );
+        job->ty0 = floorDiv( job->view->y, RND_TILE_SIZE );
+        job->tilesx = (int)(floorDiv( job->view->x + job->w - 1, RND_TILE_SIZE ) - job->tx0 + 1);
+        job->tilesy = (int)(floorDiv( job->view->y + job->h - 1, RND_TILE_SIZE ) - job->ty0 + 1);
+    }
+    else
+    {
+        job->tx0 = 0;
+        job->ty0 = 0;
+        job->tilesx = (job->w + RND_TILE_SIZE - 1) / RND_TILE_SIZE;
+        job->tilesy = (job->h + RND_TILE_SIZE - 1) / RND_TILE_SIZE;
+    }
+
+    if ( job->view && !cache && cachebudget > 0 )
+    {
+        cache = CACHE_CreateCache( RND_TILE_SIZE * RND_TILE_SIZE, cachebudget );
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter( );
+    POOL_Run( pool, job->tilesx * job->tilesy, renderTile, job );
+    double ms = (SDL_GetPerformanceCounter( ) - start) * 1000.0 / SDL_GetPerformanceFrequency( );
+    int references = job->perturb ? fixGlitches( job ) : 0;
+    frame.smoothready = job->colorizer.smooth;
+    free( maps );
+
+    laststats.pixels = (uint64_t)job->w * job->h;
+    laststats.threads = threads;
+    laststats.strategy = job->strategy;
+    laststats.iterated = 0;
+    laststats.reused = 0;
+    laststats.resumed = 0;
+    laststats.tiles = 0;
+    laststats.cachedtiles = 0;
+    laststats.filetiles = 0;
+    laststats.lanesteps = 0;
+    laststats.activesteps = 0;
+    laststats.cardioidskips = 0;
+    laststats.cancelledtiles = 0;
+    laststats.cycleskips = 0;
+    laststats.referencebits = job->perturb ? 32 * (job->limbs - 1) : 0;
+    laststats.referencelength = job->perturb ? reference->length : 0;
+    laststats.references = references;
+    laststats.reiterated = 0;
+    laststats.approximation = job->approximation;
+    laststats.seriesskip = job->perturb ? series.skip : 0;
+    laststats.skippedsteps = 0;
+    laststats.rebases = 0;
+    laststats.doubledouble = job->doubledouble;
+    for ( i = 0; i < threads; i++ )
+    {
+        laststats.iterated += workers[i].iterated;
+        laststats.reused += workers[i].reused;
+        laststats.resumed += workers[i].resumed;
+        laststats.tiles += workers[i].tiles;
+        laststats.cachedtiles += workers[i].cachedtiles;
+        laststats.filetiles += workers[i].filetiles;
+        laststats.lanesteps += workers[i].stats.lanesteps;
+        laststats.activesteps += workers[i].stats.activesteps;
+        laststats.cardioidskips += workers[i].cardioidskips;
+        laststats.cancelledtiles += workers[i].cancelledtiles;
+        laststats.cycleskips += workers[i].stats.cycles;
+        laststats.reiterated += workers[i].reiterated;
+        laststats.skippedsteps += workers[i].skippedsteps;
+        laststats.rebases += workers[i].rebases;
+    }
+
+    /* At the rate the tiles iterated, skipping took this long off them. */
+    laststats.savedms = 0;
+    if ( laststats.lanesteps )
+    {
+        laststats.savedms = ms * laststats.skippedsteps / laststats.lanesteps;
+    }
+
+    if ( laststats.cancelledtiles )
+    {
+        frame.transient = 1;
+    }
+    return 1;
+}
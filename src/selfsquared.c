@@ -8,6 +8,7 @@
 */
 
 #include "fractals.h"
+#include "render.h"
 
 static inline uint16_t getIterations(double zx0, double zy0, double cx0, double cy0, uint16_t max)
 {
@@ -24,6 +25,22 @@ static inline uint16_t getIterations(double zx0, double zy0, double cx0, double
     return iterations;
 }
 
+int MandelbrotInterior( double cx, double cy )
+{
+    double y2 = cy * cy;
+
+    /* Period-2 bulb: the disk of radius 1/4 centered on -1. */
+    if ( (cx + 1) * (cx + 1) + y2 <= 0.0625 )
+    {
+        return 1;
+    }
+
+    /* Main cardioid, in the form q (q + (x - 1/4)) <= y^2 / 4. */
+    double xq = cx - 0.25;
+    double q = xq * xq + y2;
+    return q * (q + xq) <= 0.25 * y2;
+}
+
 #define MAX_ITERATIONS_DEFAULT 400
 void PlotJulia( complex double c, uint16_t* buf, uint16_t w, uint16_t h,
                 complex double upperleft, complex double lowerright, uint16_t* maxiter )
@@ -91,19 +108,48 @@ void PlotMandelbrot( uint16_t* buf, uint16_t w, uint16_t h,
 }
 
 
-void PlotJuliaF( complex double c, void* buf, size_t elsize, int pitch, uint16_t w, uint16_t h,
-                 complex double upperleft, complex double lowerright, uint16_t* maxiter,
-                 PlotFunction func )
+static void initJob( RND_Job* job, int julia, double cx0, double cy0, void* buf, int pitch,
+                     uint16_t w, uint16_t h, const double* xs, const double* ys,
+                     double pixelsize, const FractalView* view, uint16_t realmax,
+                     const SpanColorizer* colorizer )
 {
-    uint16_t realmax = MAX_ITERATIONS_DEFAULT;
-    if ( maxiter )
-    {
-        realmax = *maxiter;
-    }
+    job->julia = julia;
+    job->cx = cx0;
+    job->cy = cy0;
+    job->w = w;
+    job->h = h;
+    job->xs = xs;
+    job->ys = ys;
+    job->pixelsize = pixelsize;
+    job->maxiter = realmax;
+    job->view = view;
+    job->perturb = 0;
+    job->doubledouble = 0;
+    BIG_FromDouble( &job->cre, cx0 );
+    BIG_FromDouble( &job->cim, cy0 );
+    job->buf = buf;
+    job->pitch = pitch;
+    job->colorizer = *colorizer;
+}
 
-    double cx0 = creal( c );
-    double cy0 = cimag( c );
+/* Hands a frame whose pixel coordinates are xs and ys to the tiled
+   renderer. Returns 0 if out of memory. */
+static int plotCoordinates( int julia, double cx0, double cy0, void* buf, int pitch,
+                            uint16_t w, uint16_t h, const double* xs, const double* ys,
+                            double pixelsize, const FractalView* view, uint16_t realmax,
+                            const SpanColorizer* colorizer )
+{
+    RND_Job job;
+    initJob( &job, julia, cx0, cy0, buf, pitch, w, h, xs, ys, pixelsize, view, realmax, colorizer );
+    return RND_Render( &job );
+}
 
+/* Shared body of the F and Spans plotters. Pixel coordinates are
+   accumulated exactly as a pixel-by-pixel walk would. */
+static void plotRows( int julia, double cx0, double cy0, void* buf, int pitch,
+                      uint16_t w, uint16_t h, complex double upperleft, complex double lowerright,
+                      uint16_t realmax, const SpanColorizer* colorizer )
+{
     double xi = creal( upperleft );
     double xf = creal( lowerright );
 
@@ -112,28 +158,388 @@ void PlotJuliaF( complex double c, void* buf, size_t elsize, int pitch, uint16_t
 
     double dx = (xf - xi) / (double)w;
     double dy = (yf - yi) / (double)h;
-    
+
+    double* xs = malloc( w * sizeof(double) );
+    double* ys = malloc( h * sizeof(double) );
+    if ( !xs || !ys )
+    {
+        free( xs );
+        free( ys );
+        return;
+    }
+
     double x = xi;
     double y = yi;
 
-    uint32_t dypixels = pitch - elsize * w;
-
     int i, j;
+    for ( i = 0; i < w; i++, x += dx )
+    {
+        xs[i] = x;
+    }
     for ( j = 0; j < h; j++, y += dy )
     {
-        for ( i = 0; i < w; i++, x += dx )
-        {
-            (*func)( getIterations( x, y, cx0, cy0, realmax ), buf );
-            buf += elsize;
-        }
-        x = xi;
-        buf += dypixels;
+        ys[j] = y;
     }
+
+    plotCoordinates( julia, cx0, cy0, buf, pitch, w, h, xs, ys,
+                     fmin( fabs( dx ), fabs( dy ) ), NULL, realmax, colorizer );
+
+    free( xs );
+    free( ys );
 }
 
-void PlotMandelbrotF( void* buf, size_t elsize, int pitch, uint16_t w, uint16_t h,
-                     complex double upperleft, complex double lowerright, uint16_t* maxiter,
-                     PlotFunction func )
+/* Views fold x and y into their origin before these grow past int64_t. */
+#define VIEW_FOLD ((int64_t)1 << 60)
+
+/* Grid point n of one axis of a view, in high precision. */
+static void gridPoint( double origin, const BIG_Number* offset, double step, int level, int64_t n,
+                       BIG_Number* point )
+{
+    BIG_Number scaled;
+    BIG_FromDouble( &scaled, step );
+    BIG_Ldexp( &scaled, &scaled, -level );
+    BIG_MulInt( &scaled, &scaled, n );
+    BIG_FromDouble( point, origin );
+    BIG_Add( point, point, offset );
+    BIG_Add( point, point, &scaled );
+}
+
+/* Makes origin the view's origin on one axis, as a double and the high
+   precision remainder. */
+static void setOrigin( const BIG_Number* origin, double* re, BIG_Number* offset )
+{
+    BIG_Number rounded;
+    *re = BIG_ToDouble( origin );
+    BIG_FromDouble( &rounded, *re );
+    BIG_Sub( offset, origin, &rounded );
+}
+
+double ViewPixelSize( const FractalView* view )
+{
+    return ldexp( fmin( fabs( view->dre ), fabs( view->dim ) ), -view->level );
+}
+
+void SetView( FractalView* view, complex double upperleft, complex double lowerright,
+              uint16_t w, uint16_t h )
+{
+    view->re = creal( upperleft );
+    view->im = cimag( upperleft );
+    view->dre = (creal( lowerright ) - view->re) / w;
+    view->dim = (cimag( lowerright ) - view->im) / h;
+    view->level = 0;
+    view->x = 0;
+    view->y = 0;
+    view->preview = 0;
+    BIG_Zero( &view->offre );
+    BIG_Zero( &view->offim );
+}
+
+void ZoomView( FractalView* view, int i, int j )
+{
+    if ( ViewPixelSize( view ) / 2 < VIEW_MIN_PIXELSIZE )
+    {
+        return;
+    }
+
+    view->level++;
+    view->x = 2 * view->x + i;
+    view->y = 2 * view->y + j;
+
+    /* Only deep views get this far, and they are not on the tile cache's
+       grid, so moving their origin costs nothing. */
+    if ( view->x > VIEW_FOLD || view->x < -VIEW_FOLD || view->y > VIEW_FOLD || view->y < -VIEW_FOLD )
+    {
+        BIG_Number origin;
+        gridPoint( view->re, &view->offre, view->dre, view->level, view->x, &origin );
+        setOrigin( &origin, &view->re, &view->offre );
+        gridPoint( view->im, &view->offim, view->dim, view->level, view->y, &origin );
+        setOrigin( &origin, &view->im, &view->offim );
+        view->x = 0;
+        view->y = 0;
+    }
+}
+
+void ScaleView( FractalView* view, double ratio, int i, int j )
+{
+    if ( ratio == 2 )
+    {
+        ZoomView( view, i, j );
+        return;
+    }
+
+    double dre = ldexp( view->dre, -view->level ) / ratio;
+    double dim = ldexp( view->dim, -view->level ) / ratio;
+    if ( ratio > 1 && fmin( fabs( dre ), fabs( dim ) ) < VIEW_MIN_PIXELSIZE )
+    {
+        return;
+    }
+
+    /* The new origin is i new pixels left of the fixed point, and j up. */
+    BIG_Number fixed, shift;
+    gridPoint( view->re, &view->offre, view->dre, view->level, view->x + i, &fixed );
+    BIG_FromDouble( &shift, dre );
+    BIG_MulInt( &shift, &shift, i );
+    BIG_Sub( &fixed, &fixed, &shift );
+    setOrigin( &fixed, &view->re, &view->offre );
+
+    gridPoint( view->im, &view->offim, view->dim, view->level, view->y + j, &fixed );
+    BIG_FromDouble( &shift, dim );
+    BIG_MulInt( &shift, &shift, j );
+    BIG_Sub( &fixed, &fixed, &shift );
+    setOrigin( &fixed, &view->im, &view->offim );
+
+    view->dre = dre;
+    view->dim = dim;
+    view->level = 0;
+    view->x = 0;
+    view->y = 0;
+    view->preview = 0;
+}
+
+complex double ViewPoint( const FractalView* view, int i, int j )
+{
+    return RND_GridPoint( view->re, view->dre, view->level, view->x + i ) + BIG_ToDouble( &view->offre )
+           + (RND_GridPoint( view->im, view->dim, view->level, view->y + j )
+              + BIG_ToDouble( &view->offim )) * I;
+}
+
+void ViewPrecisePoint( const FractalView* view, int i, int j, FractalPoint* point )
+{
+    BIG_Number coordinate;
+    gridPoint( view->re, &view->offre, view->dre, view->level, view->x + i, &coordinate );
+    setOrigin( &coordinate, &point->re, &point->offre );
+    gridPoint( view->im, &view->offim, view->dim, view->level, view->y + j, &coordinate );
+    setOrigin( &coordinate, &point->im, &point->offim );
+}
+
+void SetPoint( FractalPoint* point, complex double c )
+{
+    point->re = creal( c );
+    point->im = cimag( c );
+    BIG_Zero( &point->offre );
+    BIG_Zero( &point->offim );
+}
+
+int SamePoint( const FractalPoint* a, const FractalPoint* b )
+{
+    return a->re == b->re && a->im == b->im && BIG_Equal( &a->offre, &b->offre )
+           && BIG_Equal( &a->offim, &b->offim );
+}
+
+/* The Julia c of a plot as doubles, and to high precision. A Mandelbrot
+   plot has none, and gets 0. */
+static void pointToDouble( const FractalPoint* c, double* cx0, double* cy0 )
+{
+    *cx0 = c ? c->re + BIG_ToDouble( &c->offre ) : 0;
+    *cy0 = c ? c->im + BIG_ToDouble( &c->offim ) : 0;
+}
+
+static void pointToBig( const FractalPoint* c, BIG_Number* cre, BIG_Number* cim )
+{
+    BIG_Zero( cre );
+    BIG_Zero( cim );
+    if ( c )
+    {
+        BIG_FromDouble( cre, c->re );
+        BIG_Add( cre, cre, &c->offre );
+        BIG_FromDouble( cim, c->im );
+        BIG_Add( cim, cim, &c->offim );
+    }
+}
+
+complex double ViewOffset( const FractalView* from, const FractalView* to )
+{
+    BIG_Number a, b;
+    gridPoint( from->re, &from->offre, from->dre, from->level, from->x, &a );
+    gridPoint( to->re, &to->offre, to->dre, to->level, to->x, &b );
+    BIG_Sub( &a, &a, &b );
+    double re = BIG_ToDouble( &a );
+
+    gridPoint( from->im, &from->offim, from->dim, from->level, from->y, &a );
+    gridPoint( to->im, &to->offim, to->dim, to->level, to->y, &b );
+    BIG_Sub( &a, &a, &b );
+    return re + BIG_ToDouble( &a ) * I;
+}
+
+void PreviewView( FractalView* preview, const FractalView* view, int shift,
+                  int* offx, int* offy )
+{
+    int64_t d = (int64_t)1 << shift;
+
+    *preview = *view;
+    preview->level = view->level - shift;
+    preview->x = view->x >= 0 ? view->x / d : -((-view->x + d - 1) / d);
+    preview->y = view->y >= 0 ? view->y / d : -((-view->y + d - 1) / d);
+    preview->preview = 1;
+
+    *offx = (int)(view->x - preview->x * d);
+    *offy = (int)(view->y - preview->y * d);
+}
+
+/* The reference point of the last deep plot. It is kept for as long as
+   it stays in view, so that the passes of a progressive plot, pans and a
+   raised maxiter all iterate off the same orbit, which the renderer then
+   only computes once. */
+static int havereference = 0;
+static BIG_Number referencere, referenceim;
+
+/* Plots a view too deep for doubles, in double-double arithmetic or by
+   perturbation, with pixel coordinates given as offsets from the
+   reference point. Returns 0 if out of memory. */
+static int plotDeep( int julia, const FractalPoint* c, void* buf, int pitch,
+                     uint16_t w, uint16_t h, const FractalView* view,
+                     uint16_t realmax, const SpanColorizer* colorizer )
+{
+    double* xs = malloc( w * sizeof(double) );
+    double* ys = malloc( h * sizeof(double) );
+    if ( !xs || !ys )
+    {
+        free( xs );
+        free( ys );
+        return 0;
+    }
+
+    BIG_Number point;
+    int keep = 0;
+    if ( havereference )
+    {
+        gridPoint( view->re, &view->offre, view->dre, view->level, view->x, &point );
+        BIG_Sub( &point, &referencere, &point );
+        double px = BIG_ToDouble( &point ) / ldexp( view->dre, -view->level );
+        gridPoint( view->im, &view->offim, view->dim, view->level, view->y, &point );
+        BIG_Sub( &point, &referenceim, &point );
+        double py = BIG_ToDouble( &point ) / ldexp( view->dim, -view->level );
+        keep = px >= 0 && px < w && py >= 0 && py < h;
+    }
+    if ( !keep )
+    {
+        gridPoint( view->re, &view->offre, view->dre, view->level, view->x + w / 2, &referencere );
+        gridPoint( view->im, &view->offim, view->dim, view->level, view->y + h / 2, &referenceim );
+        havereference = 1;
+    }
+
+    int i, j;
+    for ( i = 0; i < w; i++ )
+    {
+        gridPoint( view->re, &view->offre, view->dre, view->level, view->x + i, &point );
+        BIG_Sub( &point, &point, &referencere );
+        xs[i] = BIG_ToDouble( &point );
+    }
+    for ( j = 0; j < h; j++ )
+    {
+        gridPoint( view->im, &view->offim, view->dim, view->level, view->y + j, &point );
+        BIG_Sub( &point, &point, &referenceim );
+        ys[j] = BIG_ToDouble( &point );
+    }
+
+    /* The orbit is held to 64 bits below a pixel. */
+    double pixelsize = ViewPixelSize( view );
+    double cx0, cy0;
+    pointToDouble( c, &cx0, &cy0 );
+    RND_Job job;
+    initJob( &job, julia, cx0, cy0, buf, pitch, w, h, xs, ys, pixelsize, NULL, realmax, colorizer );
+    job.perturb = pixelsize < PERTURB_PIXELSIZE;
+    job.doubledouble = !job.perturb;
+    pointToBig( c, &job.cre, &job.cim );
+    job.refre = referencere;
+    job.refim = referenceim;
+    job.limbs = BIG_LimbsFor( (int)ceil( -log2( pixelsize ) ) + 64 );
+    int ok = RND_Render( &job );
+
+    free( xs );
+    free( ys );
+    return ok;
+}
+
+/* Shared body of the View plotters. c is NULL for the Mandelbrot set. */
+static int plotView( int julia, const FractalPoint* c, void* buf, int pitch,
+                     uint16_t w, uint16_t h, const FractalView* view,
+                     uint16_t realmax, const SpanColorizer* colorizer )
+{
+    if ( ViewPixelSize( view ) < DEEP_PIXELSIZE )
+    {
+        return plotDeep( julia, c, buf, pitch, w, h, view, realmax, colorizer );
+    }
+
+    double* xs = malloc( w * sizeof(double) );
+    double* ys = malloc( h * sizeof(double) );
+    if ( !xs || !ys )
+    {
+        free( xs );
+        free( ys );
+        return 0;
+    }
+
+    int i, j;
+    for ( i = 0; i < w; i++ )
+    {
+        xs[i] = RND_GridPoint( view->re, view->dre, view->level, view->x + i );
+    }
+    for ( j = 0; j < h; j++ )
+    {
+        ys[j] = RND_GridPoint( view->im, view->dim, view->level, view->y + j );
+    }
+
+    double pixelsize = ViewPixelSize( view );
+    double cx0, cy0;
+    pointToDouble( c, &cx0, &cy0 );
+    int ok = plotCoordinates( julia, cx0, cy0, buf, pitch, w, h, xs, ys, pixelsize, view,
+                              realmax, colorizer );
+
+    free( xs );
+    free( ys );
+    return ok;
+}
+
+/* Shared body of the Realtime plotters. The view's grid points are moved
+   onto the last frame's columns and rows where close enough, and the
+   frame is plotted as plain coordinates, which keeps it off the grid and
+   out of the tile cache. Deep frames have nothing to snap to, and are
+   plotted whole. */
+static int plotRealtime( int julia, const FractalPoint* c, void* buf, int pitch,
+                         uint16_t w, uint16_t h, const FractalView* view, uint16_t realmax,
+                         double tolerance, const SpanColorizer* colorizer )
+{
+    if ( ViewPixelSize( view ) < DEEP_PIXELSIZE )
+    {
+        return plotDeep( julia, c, buf, pitch, w, h, view, realmax, colorizer );
+    }
+
+    double* xs = malloc( w * sizeof(double) );
+    double* ys = malloc( h * sizeof(double) );
+    if ( !xs || !ys )
+    {
+        free( xs );
+        free( ys );
+        return 0;
+    }
+
+    int i, j;
+    for ( i = 0; i < w; i++ )
+    {
+        xs[i] = RND_GridPoint( view->re, view->dre, view->level, view->x + i );
+    }
+    for ( j = 0; j < h; j++ )
+    {
+        ys[j] = RND_GridPoint( view->im, view->dim, view->level, view->y + j );
+    }
+
+    double dx = fabs( ldexp( view->dre, -view->level ) );
+    double dy = fabs( ldexp( view->dim, -view->level ) );
+    RND_SnapToFrame( xs, w, ys, h, tolerance * dx, tolerance * dy );
+
+    double cx0, cy0;
+    pointToDouble( c, &cx0, &cy0 );
+    int ok = plotCoordinates( julia, cx0, cy0, buf, pitch, w, h, xs, ys, fmin( dx, dy ), NULL,
+                              realmax, colorizer );
+
+    free( xs );
+    free( ys );
+    return ok;
+}
+
+int PlotJuliaView( const FractalPoint* c, void* buf, int pitch, uint16_t w, uint16_t h,
+                   const FractalView* view, uint16_t* maxiter, const SpanColorizer* colorizer )
 {
     uint16_t realmax = MAX_ITERATIONS_DEFAULT;
     if ( maxiter )
@@ -141,29 +547,91 @@ void PlotMandelbrotF( void* buf, size_t elsize, int pitch, uint16_t w, uint16_t
         realmax = *maxiter;
     }
 
-    double xi = creal( upperleft );
-    double xf = creal( lowerright );
+    return plotView( 1, c, buf, pitch, w, h, view, realmax, colorizer );
+}
 
-    double yi = cimag( upperleft );
-    double yf = cimag( lowerright );
+int PlotMandelbrotView( void* buf, int pitch, uint16_t w, uint16_t h,
+                        const FractalView* view, uint16_t* maxiter, const SpanColorizer* colorizer )
+{
+    uint16_t realmax = MAX_ITERATIONS_DEFAULT;
+    if ( maxiter )
+    {
+        realmax = *maxiter;
+    }
 
-    double dx = (xf - xi) / (double)w;
-    double dy = (yf - yi) / (double)h;
+    return plotView( 0, NULL, buf, pitch, w, h, view, realmax, colorizer );
+}
 
-    double x = xi;
-    double y = yi;
+int PlotJuliaRealtime( const FractalPoint* c, void* buf, int pitch, uint16_t w, uint16_t h,
+                       const FractalView* view, uint16_t* maxiter, double tolerance,
+                       const SpanColorizer* colorizer )
+{
+    uint16_t realmax = MAX_ITERATIONS_DEFAULT;
+    if ( maxiter )
+    {
+        realmax = *maxiter;
+    }
 
-    uint32_t dypixels = pitch - elsize * w;
+    return plotRealtime( 1, c, buf, pitch, w, h, view, realmax, tolerance, colorizer );
+}
 
-    int i, j;
-    for ( j = 0; j < h; j++, y += dy )
+int PlotMandelbrotRealtime( void* buf, int pitch, uint16_t w, uint16_t h,
+                            const FractalView* view, uint16_t* maxiter, double tolerance,
+                            const SpanColorizer* colorizer )
+{
+    uint16_t realmax = MAX_ITERATIONS_DEFAULT;
+    if ( maxiter )
     {
-        for ( i = 0; i < w; i++, x += dx )
-        {
-            (*func)( getIterations( 0, 0, x, y, realmax ), buf );
-            buf += elsize;
-        }
-        x = xi;
-        buf += dypixels;
+        realmax = *maxiter;
+    }
+
+    return plotRealtime( 0, NULL, buf, pitch, w, h, view, realmax, tolerance, colorizer );
+}
+
+void PlotJuliaSpans( complex double c, void* buf, int pitch, uint16_t w, uint16_t h,
+                     complex double upperleft, complex double lowerright, uint16_t* maxiter,
+                     const SpanColorizer* colorizer )
+{
+    uint16_t realmax = MAX_ITERATIONS_DEFAULT;
+    if ( maxiter )
+    {
+        realmax = *maxiter;
+    }
+
+    plotRows( 1, creal( c ), cimag( c ), buf, pitch, w, h,
+              upperleft, lowerright, realmax, colorizer );
+}
+
+void PlotMandelbrotSpans( void* buf, int pitch, uint16_t w, uint16_t h,
+                          complex double upperleft, complex double lowerright, uint16_t* maxiter,
+                          const SpanColorizer* colorizer )
+{
+    uint16_t realmax = MAX_ITERATIONS_DEFAULT;
+    if ( maxiter )
+    {
+        realmax = *maxiter;
     }
+
+    plotRows( 0, 0, 0, buf, pitch, w, h,
+              upperleft, lowerright, realmax, colorizer );
+}
+
+void PlotJuliaF( complex double c, void* buf, size_t elsize, int pitch, uint16_t w, uint16_t h,
+                 complex double upperleft, complex double lowerright, uint16_t* maxiter,
+                 PlotFunction func )
+{
+    SpanColorizer colorizer;
+    RND_PlotAdapter adapter;
+    RND_AdaptPlotFunction( &colorizer, &adapter, func, elsize );
+    PlotJuliaSpans( c, buf, pitch, w, h, upperleft, lowerright, maxiter, &colorizer );
+}
+
+void PlotMandelbrotF( void* buf, size_t elsize, int pitch, uint16_t w, uint16_t h,
+                     complex double upperleft, complex double lowerright, uint16_t* maxiter,
+                     PlotFunction func )
+{
+    SpanColorizer colorizer;
+    RND_PlotAdapter adapter;
+    RND_AdaptPlotFunction( &colorizer, &adapter, func, elsize );
+    PlotMandelbrotSpans( buf, pitch, w, h, upperleft, lowerright, maxiter, &colorizer );
 }
@@ -0,0 +1,327 @@
+/*
+
+    Implementation file for the vectorized escape-time batch engine.
+    The engine iterates z = z^2 + c on SIMD_LANES pixels at once. Whenever a
+    lane's pixel escapes or reaches max, the lane is refilled with the next
+    pending pixel, so lanes do not sit idle waiting for the slowest pixel.
+
+*/
+
+#include "stdlib.h"
+#include "math.h"
+#include "simd.h"
+
+#if SIMD_AVX2_BUILT
+#include "immintrin.h"
+#endif
+
+SIMD_Batch* SIMD_CreateBatch( int capacity )
+{
+    SIMD_Batch* batch = malloc( sizeof(SIMD_Batch) );
+    if ( !batch )
+    {
+        return NULL;
+    }
+
+    batch->count = 0;
+    batch->capacity = capacity;
+    batch->zx = malloc( capacity * sizeof(double) );
+    batch->zy = malloc( capacity * sizeof(double) );
+    batch->cx = malloc( capacity * sizeof(double) );
+    batch->cy = malloc( capacity * sizeof(double) );
+    batch->iter = malloc( capacity * sizeof(uint16_t) );
+    batch->index = malloc( capacity * sizeof(uint32_t) );
+
+    if ( !batch->zx || !batch->zy || !batch->cx || !batch->cy || !batch->iter || !batch->index )
+    {
+        SIMD_DestroyBatch( batch );
+        return NULL;
+    }
+
+    return batch;
+}
+
+void SIMD_DestroyBatch( SIMD_Batch* batch )
+{
+    if ( batch )
+    {
+        free( batch->zx );
+        free( batch->zy );
+        free( batch->cx );
+        free( batch->cy );
+        free( batch->iter );
+        free( batch->index );
+        free( batch );
+    }
+}
+
+static void runBatchScalar( SIMD_Batch* batch, uint16_t max, double tolerance,
+                            SIMD_BatchOutput* out, SIMD_BatchStats* stats )
+{
+    uint64_t steps = 0;
+    uint64_t cycles = 0;
+
+    int n;
+    for ( n = 0; n < batch->count; n++ )
+    {
+        double zx0 = batch->zx[n];
+        double zy0 = batch->zy[n];
+        double cx0 = batch->cx[n];
+        double cy0 = batch->cy[n];
+        uint16_t iterations = batch->iter[n];
+        int cycled = 0;
+        double xtemp;
+
+        /* Brent's cycle detection: z is saved after 1, 2, 4, 8, ... steps,
+           and an orbit that comes back within tolerance of the saved value
+           is periodic and will never escape. */
+        double savedx = zx0;
+        double savedy = zy0;
+        uint32_t window = 1;
+        uint32_t nextsave = iterations + window;
+
+        while (zx0 * zx0 + zy0 * zy0 < 2 * 2 && iterations < max) {
+            xtemp = zx0;
+            zx0 = zx0 * zx0 - zy0 * zy0 + cx0;
+            zy0 = 2 * xtemp * zy0 + cy0;
+            iterations++;
+            steps++;
+
+            if ( tolerance > 0 )
+            {
+                if ( fabs( zx0 - savedx ) < tolerance && fabs( zy0 - savedy ) < tolerance )
+                {
+                    iterations = max;
+                    cycles++;
+                    cycled = 1;
+                    break;
+                }
+                if ( iterations == nextsave )
+                {
+                    savedx = zx0;
+                    savedy = zy0;
+                    window *= 2;
+                    nextsave = iterations + window;
+                }
+            }
+        }
+
+        uint32_t index = batch->index[n];
+        out->iter[index] = iterations;
+        if ( cycled && out->cycled )
+        {
+            out->cycled[index] = 1;
+        }
+        out->zx[index] = zx0;
+        out->zy[index] = zy0;
+    }
+
+    stats->lanesteps += steps;
+    stats->activesteps += steps;
+    stats->cycles += cycles;
+}
+
+#if SIMD_AVX2_BUILT
+
+int SIMD_HasAVX2( void )
+{
+    static int checked = 0;
+    static int supported = 0;
+    if ( !checked )
+    {
+        __builtin_cpu_init( );
+        supported = __builtin_cpu_supports( "avx2" ) ? 1 : 0;
+        checked = 1;
+    }
+    return supported;
+}
+
+/* Each lane follows the scalar kernel exactly: the operations are performed
+   in the same order, and a lane's z is frozen as soon as it escapes or
+   reaches max, so its count is identical bit for bit. Lanes are refilled
+   from the batch between runs of vector steps, whenever one of them stops. */
+__attribute__((target("avx2")))
+static void runBatchAVX2( SIMD_Batch* batch, uint16_t max, double tolerance,
+                          SIMD_BatchOutput* out, SIMD_BatchStats* stats )
+{
+    double lzx[SIMD_LANES], lzy[SIMD_LANES], lcx[SIMD_LANES], lcy[SIMD_LANES];
+    double lsavedx[SIMD_LANES], lsavedy[SIMD_LANES];
+    int64_t lit[SIMD_LANES], lwindow[SIMD_LANES], lnextsave[SIMD_LANES];
+    int64_t occupied[SIMD_LANES];
+    int slot[SIMD_LANES];
+
+    const __m256d four = _mm256_set1_pd( 2 * 2 );
+    const __m256d two = _mm256_set1_pd( 2 );
+    const __m256d sign = _mm256_set1_pd( -0.0 );
+    const __m256d tol = _mm256_set1_pd( tolerance );
+    const __m256i limit = _mm256_set1_epi64x( max );
+    const int periodic = tolerance > 0;
+
+    uint64_t lanesteps = 0;
+    uint64_t activesteps = 0;
+    uint64_t cycles = 0;
+    int next = 0;
+    int lane;
+
+    for ( lane = 0; lane < SIMD_LANES; lane++ )
+    {
+        lzx[lane] = lzy[lane] = lcx[lane] = lcy[lane] = 0;
+        lsavedx[lane] = lsavedy[lane] = 0;
+        lit[lane] = max;
+        lwindow[lane] = lnextsave[lane] = 0;
+        slot[lane] = -1;
+    }
+
+    for (;;)
+    {
+        /* Retire finished lanes and refill them with pending pixels. A pixel
+           that is already finished when loaded is retired on the spot. */
+        int live = 0;
+        for ( lane = 0; lane < SIMD_LANES; lane++ )
+        {
+            for (;;)
+            {
+                if ( slot[lane] >= 0 )
+                {
+                    if ( lzx[lane] * lzx[lane] + lzy[lane] * lzy[lane] < 2 * 2 && lit[lane] < max )
+                    {
+                        live |= 1 << lane;
+                        break;
+                    }
+                    uint32_t index = batch->index[slot[lane]];
+                    out->iter[index] = (uint16_t)lit[lane];
+                    out->zx[index] = lzx[lane];
+                    out->zy[index] = lzy[lane];
+                    slot[lane] = -1;
+                }
+
+                if ( next >= batch->count )
+                {
+                    break;
+                }
+
+                lzx[lane] = lsavedx[lane] = batch->zx[next];
+                lzy[lane] = lsavedy[lane] = batch->zy[next];
+                lcx[lane] = batch->cx[next];
+                lcy[lane] = batch->cy[next];
+                lit[lane] = batch->iter[next];
+                lwindow[lane] = 1;
+                lnextsave[lane] = lit[lane] + 1;
+                slot[lane] = next++;
+            }
+            occupied[lane] = slot[lane] >= 0 ? -1 : 0;
+        }
+
+        if ( !live )
+        {
+            break;
+        }
+
+        __m256d zx = _mm256_loadu_pd( lzx );
+        __m256d zy = _mm256_loadu_pd( lzy );
+        __m256d cx = _mm256_loadu_pd( lcx );
+        __m256d cy = _mm256_loadu_pd( lcy );
+        __m256d savedx = _mm256_loadu_pd( lsavedx );
+        __m256d savedy = _mm256_loadu_pd( lsavedy );
+        __m256i iterations = _mm256_loadu_si256( (const __m256i*)lit );
+        __m256i window = _mm256_loadu_si256( (const __m256i*)lwindow );
+        __m256i nextsave = _mm256_loadu_si256( (const __m256i*)lnextsave );
+        __m256d active = _mm256_castsi256_pd( _mm256_loadu_si256( (const __m256i*)occupied ) );
+
+        __m256d zx2 = _mm256_mul_pd( zx, zx );
+        __m256d zy2 = _mm256_mul_pd( zy, zy );
+
+        /* Step until one of the live lanes stops. */
+        int mask = live;
+        while ( mask == live )
+        {
+            __m256d xtemp = _mm256_add_pd( _mm256_sub_pd( zx2, zy2 ), cx );
+            __m256d ytemp = _mm256_add_pd( _mm256_mul_pd( _mm256_mul_pd( two, zx ), zy ), cy );
+            zx = _mm256_blendv_pd( zx, xtemp, active );
+            zy = _mm256_blendv_pd( zy, ytemp, active );
+
+            /* Active lanes hold all ones, so subtracting the mask counts them. */
+            iterations = _mm256_sub_epi64( iterations, _mm256_castpd_si256( active ) );
+
+            lanesteps += SIMD_LANES;
+            activesteps += __builtin_popcount( mask );
+
+            if ( periodic )
+            {
+                __m256d nearx = _mm256_cmp_pd( _mm256_andnot_pd( sign, _mm256_sub_pd( zx, savedx ) ), tol, _CMP_LT_OQ );
+                __m256d neary = _mm256_cmp_pd( _mm256_andnot_pd( sign, _mm256_sub_pd( zy, savedy ) ), tol, _CMP_LT_OQ );
+                __m256d cycle = _mm256_and_pd( active, _mm256_and_pd( nearx, neary ) );
+                int cyclemask = _mm256_movemask_pd( cycle );
+                if ( cyclemask )
+                {
+                    iterations = _mm256_castpd_si256( _mm256_blendv_pd( _mm256_castsi256_pd( iterations ),
+                                                                        _mm256_castsi256_pd( limit ), cycle ) );
+                    cycles += __builtin_popcount( cyclemask );
+                    if ( out->cycled )
+                    {
+                        for ( lane = 0; lane < SIMD_LANES; lane++ )
+                        {
+                            if ( cyclemask & (1 << lane) )
+                            {
+                                out->cycled[batch->index[slot[lane]]] = 1;
+                            }
+                        }
+                    }
+                }
+
+                __m256d save = _mm256_and_pd( active, _mm256_castsi256_pd( _mm256_cmpeq_epi64( iterations, nextsave ) ) );
+                if ( _mm256_movemask_pd( save ) )
+                {
+                    __m256i saveint = _mm256_castpd_si256( save );
+                    savedx = _mm256_blendv_pd( savedx, zx, save );
+                    savedy = _mm256_blendv_pd( savedy, zy, save );
+                    window = _mm256_blendv_epi8( window, _mm256_add_epi64( window, window ), saveint );
+                    nextsave = _mm256_blendv_epi8( nextsave, _mm256_add_epi64( iterations, window ), saveint );
+                }
+            }
+
+            zx2 = _mm256_mul_pd( zx, zx );
+            zy2 = _mm256_mul_pd( zy, zy );
+            active = _mm256_and_pd( active, _mm256_cmp_pd( _mm256_add_pd( zx2, zy2 ), four, _CMP_LT_OQ ) );
+            active = _mm256_and_pd( active, _mm256_castsi256_pd( _mm256_cmpgt_epi64( limit, iterations ) ) );
+            mask = _mm256_movemask_pd( active );
+        }
+
+        _mm256_storeu_pd( lzx, zx );
+        _mm256_storeu_pd( lzy, zy );
+        _mm256_storeu_pd( lsavedx, savedx );
+        _mm256_storeu_pd( lsavedy, savedy );
+        _mm256_storeu_si256( (__m256i*)lit, iterations );
+        _mm256_storeu_si256( (__m256i*)lwindow, window );
+        _mm256_storeu_si256( (__m256i*)lnextsave, nextsave );
+    }
+
+    stats->lanesteps += lanesteps;
+    stats->activesteps += activesteps;
+    stats->cycles += cycles;
+}
+
+#else
+
+int SIMD_HasAVX2( void )
+{
+    return 0;
+}
+
+#endif
+
+void SIMD_RunBatch( SIMD_Batch* batch, uint16_t max, double tolerance,
+                    SIMD_BatchOutput* out, SIMD_BatchStats* stats )
+{
+#if SIMD_AVX2_BUILT
+    if ( SIMD_HasAVX2( ) )
+    {
+        runBatchAVX2( batch, max, tolerance, out, stats );
+        batch->count = 0;
+        return;
+    }
+#endif
+
+    runBatchScalar( batch, max, tolerance, out, stats );
+    batch->count = 0;
+}
@@ -0,0 +1,626 @@
+/*
+
+    Implementation file for the tile cache.
+    Tiles are found through a hash table of their keys and kept on a list
+    in order of use. When the tiles outgrow the budget, the least recently
+    used ones are evicted. A single lock guards the table and the list,
+    and tile data is copied in and out while holding it, so a tile never
+    changes under a reader.
+
+    A cache can also keep its tiles in a file, which survives restarts.
+    The file starts with a header giving the format version and a hash of
+    the tile layout and the caller's format, followed by fixed-size records
+    of a key and a tile, only ever appended. Opening the file indexes the
+    records it holds, and tiles are read back from a memory mapping of it,
+    so that a tile costs a page-in rather than a render. A file without the
+    header's magic is not ours, and is never written to.
+
+*/
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "stdio.h"
+#include "string.h"
+#include "SDL.h"
+#include "tilecache.h"
+
+#ifdef _WIN32
+#include "windows.h"
+#include "io.h"
+#else
+#include "sys/mman.h"
+#include "unistd.h"
+#endif
+
+#define CACHE_BUCKETS 4096
+
+#define CACHE_FILE_VERSION 1
+#define CACHE_RECORD_MAGIC 0x454C4954u
+
+typedef struct _Entry
+{
+    CACHE_Key key;
+    uint32_t hash;
+    struct _Entry* chain;
+    struct _Entry* newer;
+    struct _Entry* older;
+
+    uint16_t* iterations;
+    uint8_t* flags;
+    double* zx;
+    double* zy;
+} CACHE_Entry;
+
+/* Where a tile is stored in the file. */
+typedef struct _Stored
+{
+    CACHE_Key key;
+    uint32_t hash;
+    size_t offset;
+    struct _Stored* chain;
+} CACHE_Stored;
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t layout;
+} CACHE_FileHeader;
+
+/* A record is this header followed by the tile's zx, zy, iterations and
+   flags arrays, padded to a multiple of 8 bytes. */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t hash;
+    CACHE_Key key;
+} CACHE_RecordHeader;
+
+struct _TileCache
+{
+    int pixels;
+    size_t budget;
+    size_t used;
+    size_t entrysize;
+
+    SDL_mutex* lock;
+    CACHE_Entry* buckets[CACHE_BUCKETS];
+    CACHE_Entry* newest;
+    CACHE_Entry* oldest;
+
+    FILE* file;
+    size_t filesize;
+    size_t filelimit;
+    size_t recordsize;
+    uint32_t format;
+    CACHE_Stored* stored[CACHE_BUCKETS];
+    uint8_t* map;
+    size_t mapsize;
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+};
+
+static uint32_t mix( uint32_t hash, const void* data, size_t size )
+{
+    const uint8_t* bytes = data;
+    size_t n;
+    for ( n = 0; n < size; n++ )
+    {
+        hash = (hash ^ bytes[n]) * 16777619u;
+    }
+    return hash;
+}
+
+/* FNV-1a over the fields of the key, so that padding does not count. */
+static uint32_t hashKey( const CACHE_Key* key )
+{
+    uint32_t hash = 2166136261u;
+    hash = mix( hash, &key->settings, sizeof(key->settings) );
+    hash = mix( hash, &key->julia, sizeof(key->julia) );
+    hash = mix( hash, &key->cx, sizeof(key->cx) );
+    hash = mix( hash, &key->cy, sizeof(key->cy) );
+    hash = mix( hash, &key->re, sizeof(key->re) );
+    hash = mix( hash, &key->im, sizeof(key->im) );
+    hash = mix( hash, &key->dre, sizeof(key->dre) );
+    hash = mix( hash, &key->dim, sizeof(key->dim) );
+    hash = mix( hash, &key->maxiter, sizeof(key->maxiter) );
+    hash = mix( hash, &key->level, sizeof(key->level) );
+    hash = mix( hash, &key->tx, sizeof(key->tx) );
+    hash = mix( hash, &key->ty, sizeof(key->ty) );
+    return hash;
+}
+
+static int sameKey( const CACHE_Key* a, const CACHE_Key* b )
+{
+    return a->settings == b->settings && a->julia == b->julia && a->cx == b->cx && a->cy == b->cy
+           && a->re == b->re && a->im == b->im && a->dre == b->dre && a->dim == b->dim
+           && a->maxiter == b->maxiter && a->level == b->level
+           && a->tx == b->tx && a->ty == b->ty;
+}
+
+static CACHE_Entry* findEntry( CACHE_Cache* cache, const CACHE_Key* key, uint32_t hash )
+{
+    CACHE_Entry* entry = cache->buckets[hash % CACHE_BUCKETS];
+    while ( entry && !(entry->hash == hash && sameKey( &entry->key, key )) )
+    {
+        entry = entry->chain;
+    }
+    return entry;
+}
+
+static CACHE_Stored* findStored( CACHE_Cache* cache, const CACHE_Key* key, uint32_t hash )
+{
+    CACHE_Stored* stored = cache->stored[hash % CACHE_BUCKETS];
+    while ( stored && !(stored->hash == hash && sameKey( &stored->key, key )) )
+    {
+        stored = stored->chain;
+    }
+    return stored;
+}
+
+static void unlinkUse( CACHE_Cache* cache, CACHE_Entry* entry )
+{
+    if ( entry->newer ) entry->newer->older = entry->older;
+    else cache->newest = entry->older;
+    if ( entry->older ) entry->older->newer = entry->newer;
+    else cache->oldest = entry->newer;
+}
+
+static void linkNewest( CACHE_Cache* cache, CACHE_Entry* entry )
+{
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if ( cache->newest ) cache->newest->newer = entry;
+    else cache->oldest = entry;
+    cache->newest = entry;
+}
+
+static void removeEntry( CACHE_Cache* cache, CACHE_Entry* entry )
+{
+    CACHE_Entry** link = &cache->buckets[entry->hash % CACHE_BUCKETS];
+    while ( *link != entry )
+    {
+        link = &(*link)->chain;
+    }
+    *link = entry->chain;
+
+    unlinkUse( cache, entry );
+    cache->used -= cache->entrysize;
+    free( entry );
+}
+
+static void evict( CACHE_Cache* cache )
+{
+    while ( cache->oldest && cache->used > cache->budget )
+    {
+        removeEntry( cache, cache->oldest );
+    }
+}
+
+/* Keeps a tile in memory, if the budget has room for any tile at all. */
+static void storeEntry( CACHE_Cache* cache, const CACHE_Key* key, uint32_t hash,
+                        const uint16_t* iterations, const uint8_t* flags,
+                        const double* zx, const double* zy )
+{
+    if ( cache->entrysize > cache->budget )
+    {
+        return;
+    }
+
+    int pixels = cache->pixels;
+    CACHE_Entry* entry = findEntry( cache, key, hash );
+    if ( entry )
+    {
+        unlinkUse( cache, entry );
+    }
+    else
+    {
+        entry = malloc( cache->entrysize );
+        if ( !entry )
+        {
+            return;
+        }
+        entry->key = *key;
+        entry->hash = hash;
+        entry->chain = cache->buckets[hash % CACHE_BUCKETS];
+        cache->buckets[hash % CACHE_BUCKETS] = entry;
+        cache->used += cache->entrysize;
+
+        entry->zx = (double*)(entry + 1);
+        entry->zy = entry->zx + pixels;
+        entry->iterations = (uint16_t*)(entry->zy + pixels);
+        entry->flags = (uint8_t*)(entry->iterations + pixels);
+    }
+    linkNewest( cache, entry );
+
+    memcpy( entry->iterations, iterations, pixels * sizeof(uint16_t) );
+    memcpy( entry->flags, flags, pixels );
+    memcpy( entry->zx, zx, pixels * sizeof(double) );
+    memcpy( entry->zy, zy, pixels * sizeof(double) );
+
+    evict( cache );
+}
+
+CACHE_Cache* CACHE_CreateCache( int pixels, size_t budget )
+{
+    CACHE_Cache* cache = calloc( 1, sizeof(CACHE_Cache) );
+    if ( !cache )
+    {
+        return NULL;
+    }
+
+    cache->lock = SDL_CreateMutex( );
+    if ( !cache->lock )
+    {
+        free( cache );
+        return NULL;
+    }
+
+    /* An entry and its arrays are allocated together, doubles first. */
+    cache->pixels = pixels;
+    cache->budget = budget;
+    cache->entrysize = sizeof(CACHE_Entry)
+                       + pixels * (2 * sizeof(double) + sizeof(uint16_t) + sizeof(uint8_t));
+    cache->recordsize = sizeof(CACHE_RecordHeader)
+                        + pixels * (2 * sizeof(double) + sizeof(uint16_t) + sizeof(uint8_t));
+    cache->recordsize = (cache->recordsize + 7) & ~(size_t)7;
+    return cache;
+}
+
+void CACHE_DestroyCache( CACHE_Cache* cache )
+{
+    if ( cache )
+    {
+        CACHE_DetachFile( cache );
+        CACHE_Clear( cache );
+        SDL_DestroyMutex( cache->lock );
+        free( cache );
+    }
+}
+
+void CACHE_SetBudget( CACHE_Cache* cache, size_t budget )
+{
+    SDL_LockMutex( cache->lock );
+    cache->budget = budget;
+    evict( cache );
+    SDL_UnlockMutex( cache->lock );
+}
+
+void CACHE_Clear( CACHE_Cache* cache )
+{
+    SDL_LockMutex( cache->lock );
+    while ( cache->oldest )
+    {
+        removeEntry( cache, cache->oldest );
+    }
+    SDL_UnlockMutex( cache->lock );
+}
+
+static void unmapFile( CACHE_Cache* cache )
+{
+    if ( cache->map )
+    {
+#ifdef _WIN32
+        UnmapViewOfFile( cache->map );
+        CloseHandle( cache->mapping );
+#else
+        munmap( cache->map, cache->mapsize );
+#endif
+    }
+    cache->map = NULL;
+    cache->mapsize = 0;
+}
+
+/* Maps the first size bytes of the file for reading. */
+static int mapFile( CACHE_Cache* cache, size_t size )
+{
+    unmapFile( cache );
+    if ( size == 0 )
+    {
+        return 1;
+    }
+
+#ifdef _WIN32
+    HANDLE handle = (HANDLE)_get_osfhandle( _fileno( cache->file ) );
+    cache->mapping = CreateFileMapping( handle, NULL, PAGE_READONLY, 0, (DWORD)size, NULL );
+    if ( !cache->mapping )
+    {
+        return 0;
+    }
+    cache->map = MapViewOfFile( cache->mapping, FILE_MAP_READ, 0, 0, size );
+    if ( !cache->map )
+    {
+        CloseHandle( cache->mapping );
+        return 0;
+    }
+#else
+    void* map = mmap( NULL, size, PROT_READ, MAP_SHARED, fileno( cache->file ), 0 );
+    if ( map == MAP_FAILED )
+    {
+        return 0;
+    }
+    cache->map = map;
+#endif
+
+    cache->mapsize = size;
+    return 1;
+}
+
+/* A hash of everything that decides how the file is laid out, and of the
+   format the caller gave for what its tiles mean, so that a file from a
+   build that lays out or computes tiles another way is never misread. */
+static uint64_t fileLayout( CACHE_Cache* cache )
+{
+    uint32_t probe = 0x01020304u;
+    uint32_t sizes[5];
+    sizes[0] = cache->pixels;
+    sizes[1] = (uint32_t)sizeof(CACHE_Key);
+    sizes[2] = (uint32_t)sizeof(double);
+    sizes[3] = (uint32_t)cache->recordsize;
+    sizes[4] = cache->format;
+
+    uint32_t hash = 2166136261u;
+    hash = mix( hash, &probe, sizeof(probe) );
+    hash = mix( hash, sizes, sizeof(sizes) );
+    return ((uint64_t)CACHE_FILE_VERSION << 32) | hash;
+}
+
+static int writeHeader( CACHE_Cache* cache )
+{
+    CACHE_FileHeader header;
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.magic, "FRACTILE", 8 );
+    header.version = CACHE_FILE_VERSION;
+    header.layout = fileLayout( cache );
+
+    return fseek( cache->file, 0, SEEK_SET ) == 0
+           && fwrite( &header, sizeof(header), 1, cache->file ) == 1
+           && fflush( cache->file ) == 0;
+}
+
+/* Returns 1 if the file holds tiles this build can read. Otherwise sets
+   ours if it is a tile cache file all the same. */
+static int readHeader( CACHE_Cache* cache, int* ours )
+{
+    CACHE_FileHeader header;
+    *ours = fseek( cache->file, 0, SEEK_SET ) == 0
+            && fread( &header, sizeof(header), 1, cache->file ) == 1
+            && memcmp( header.magic, "FRACTILE", 8 ) == 0;
+    return *ours && header.version == CACHE_FILE_VERSION && header.layout == fileLayout( cache );
+}
+
+/* Indexes the whole records in the file. A record left incomplete by an
+   interrupted write ends the file, and is written over by the next one. */
+static void indexFile( CACHE_Cache* cache )
+{
+    fseek( cache->file, 0, SEEK_END );
+    long end = ftell( cache->file );
+    size_t records = 0;
+    if ( end > (long)sizeof(CACHE_FileHeader) )
+    {
+        records = ((size_t)end - sizeof(CACHE_FileHeader)) / cache->recordsize;
+    }
+    cache->filesize = sizeof(CACHE_FileHeader);
+
+    if ( !records || !mapFile( cache, sizeof(CACHE_FileHeader) + records * cache->recordsize ) )
+    {
+        return;
+    }
+
+    size_t n;
+    for ( n = 0; n < records; n++ )
+    {
+        CACHE_RecordHeader record;
+        memcpy( &record, cache->map + cache->filesize, sizeof(record) );
+        if ( record.magic != CACHE_RECORD_MAGIC || record.hash != hashKey( &record.key ) )
+        {
+            break;
+        }
+
+        CACHE_Stored* stored = findStored( cache, &record.key, record.hash );
+        if ( !stored )
+        {
+            stored = malloc( sizeof(CACHE_Stored) );
+            if ( !stored )
+            {
+                break;
+            }
+            stored->key = record.key;
+            stored->hash = record.hash;
+            stored->chain = cache->stored[record.hash % CACHE_BUCKETS];
+            cache->stored[record.hash % CACHE_BUCKETS] = stored;
+        }
+        stored->offset = cache->filesize;
+        cache->filesize += cache->recordsize;
+    }
+}
+
+int CACHE_AttachFile( CACHE_Cache* cache, const char* path, size_t limit, const void* format,
+                      size_t formatsize )
+{
+    SDL_LockMutex( cache->lock );
+    CACHE_DetachFile( cache );
+    cache->format = mix( 2166136261u, format, formatsize );
+
+    int ours = 0;
+    cache->file = fopen( path, "r+b" );
+    if ( cache->file && !readHeader( cache, &ours ) )
+    {
+        fclose( cache->file );
+        cache->file = NULL;
+
+        /* Anything but a tile cache file is left alone. One written by
+           another version is started over below. */
+        if ( !ours )
+        {
+            SDL_UnlockMutex( cache->lock );
+            return 0;
+        }
+    }
+
+    if ( cache->file )
+    {
+        indexFile( cache );
+    }
+    else
+    {
+        cache->file = fopen( path, "w+b" );
+        if ( !cache->file || !writeHeader( cache ) )
+        {
+            if ( cache->file )
+            {
+                fclose( cache->file );
+                cache->file = NULL;
+            }
+            SDL_UnlockMutex( cache->lock );
+            return 0;
+        }
+        cache->filesize = sizeof(CACHE_FileHeader);
+    }
+
+    cache->filelimit = limit;
+    SDL_UnlockMutex( cache->lock );
+    return 1;
+}
+
+void CACHE_DetachFile( CACHE_Cache* cache )
+{
+    unmapFile( cache );
+    if ( cache->file )
+    {
+        fclose( cache->file );
+        cache->file = NULL;
+    }
+
+    int i;
+    for ( i = 0; i < CACHE_BUCKETS; i++ )
+    {
+        while ( cache->stored[i] )
+        {
+            CACHE_Stored* stored = cache->stored[i];
+            cache->stored[i] = stored->chain;
+            free( stored );
+        }
+    }
+    cache->filesize = 0;
+}
+
+/* Appends a tile to the file, unless the file is full or already has it. */
+static void appendRecord( CACHE_Cache* cache, const CACHE_Key* key, uint32_t hash,
+                          const uint16_t* iterations, const uint8_t* flags,
+                          const double* zx, const double* zy )
+{
+    if ( !cache->file || cache->filesize + cache->recordsize > cache->filelimit
+         || findStored( cache, key, hash ) )
+    {
+        return;
+    }
+
+    CACHE_Stored* stored = malloc( sizeof(CACHE_Stored) );
+    if ( !stored )
+    {
+        return;
+    }
+
+    int pixels = cache->pixels;
+    CACHE_RecordHeader record;
+    memset( &record, 0, sizeof(record) );
+    record.magic = CACHE_RECORD_MAGIC;
+    record.hash = hash;
+    record.key = *key;
+
+    size_t written = sizeof(record) + pixels * (2 * sizeof(double) + sizeof(uint16_t) + 1);
+    static const uint8_t padding[8] = { 0 };
+
+    if ( fseek( cache->file, (long)cache->filesize, SEEK_SET ) != 0
+         || fwrite( &record, sizeof(record), 1, cache->file ) != 1
+         || fwrite( zx, sizeof(double), pixels, cache->file ) != (size_t)pixels
+         || fwrite( zy, sizeof(double), pixels, cache->file ) != (size_t)pixels
+         || fwrite( iterations, sizeof(uint16_t), pixels, cache->file ) != (size_t)pixels
+         || fwrite( flags, 1, pixels, cache->file ) != (size_t)pixels
+         || fwrite( padding, 1, cache->recordsize - written, cache->file ) != cache->recordsize - written
+         || fflush( cache->file ) != 0 )
+    {
+        /* Out of space, most likely; stop writing to the file. */
+        cache->filelimit = cache->filesize;
+        free( stored );
+        return;
+    }
+
+    stored->key = *key;
+    stored->hash = hash;
+    stored->offset = cache->filesize;
+    stored->chain = cache->stored[hash % CACHE_BUCKETS];
+    cache->stored[hash % CACHE_BUCKETS] = stored;
+    cache->filesize += cache->recordsize;
+}
+
+/* Copies a tile out of the file, mapping the records appended since the
+   file was last mapped if need be. */
+static int readRecord( CACHE_Cache* cache, const CACHE_Stored* stored, uint16_t* iterations,
+                       uint8_t* flags, double* zx, double* zy )
+{
+    if ( stored->offset + cache->recordsize > cache->mapsize && !mapFile( cache, cache->filesize ) )
+    {
+        return 0;
+    }
+
+    int pixels = cache->pixels;
+    const uint8_t* data = cache->map + stored->offset + sizeof(CACHE_RecordHeader);
+    memcpy( zx, data, pixels * sizeof(double) );
+    data += pixels * sizeof(double);
+    memcpy( zy, data, pixels * sizeof(double) );
+    data += pixels * sizeof(double);
+    memcpy( iterations, data, pixels * sizeof(uint16_t) );
+    data += pixels * sizeof(uint16_t);
+    memcpy( flags, data, pixels );
+    return 1;
+}
+
+int CACHE_Lookup( CACHE_Cache* cache, const CACHE_Key* key, uint16_t* iterations,
+                  uint8_t* flags, double* zx, double* zy )
+{
+    uint32_t hash = hashKey( key );
+    int pixels = cache->pixels;
+    int found = CACHE_MISS;
+
+    SDL_LockMutex( cache->lock );
+    CACHE_Entry* entry = findEntry( cache, key, hash );
+    if ( entry )
+    {
+        unlinkUse( cache, entry );
+        linkNewest( cache, entry );
+        memcpy( iterations, entry->iterations, pixels * sizeof(uint16_t) );
+        memcpy( flags, entry->flags, pixels );
+        memcpy( zx, entry->zx, pixels * sizeof(double) );
+        memcpy( zy, entry->zy, pixels * sizeof(double) );
+        found = CACHE_MEMORY;
+    }
+    else
+    {
+        CACHE_Stored* stored = findStored( cache, key, hash );
+        if ( stored && readRecord( cache, stored, iterations, flags, zx, zy ) )
+        {
+            storeEntry( cache, key, hash, iterations, flags, zx, zy );
+            found = CACHE_FILE;
+        }
+    }
+    SDL_UnlockMutex( cache->lock );
+
+    return found;
+}
+
+void CACHE_Insert( CACHE_Cache* cache, const CACHE_Key* key, const uint16_t* iterations,
+                   const uint8_t* flags, const double* zx, const double* zy )
+{
+    uint32_t hash = hashKey( key );
+
+    SDL_LockMutex( cache->lock );
+    storeEntry( cache, key, hash, iterations, flags, zx, zy );
+    appendRecord( cache, key, hash, iterations, flags, zx, zy );
+    SDL_UnlockMutex( cache->lock );
+}